@@ -0,0 +1,59 @@
+#include "arena.hpp"
+
+// initial block, grown on reset when a frame needed more
+#define ARENA_MIN_CAPACITY (1 << 20)
+
+Arena frame_arena;
+
+Arena::~Arena() {
+    reset();
+    ::free(memory);
+}
+
+void *Arena::alloc(usize size, usize align) {
+    if (size == 0) {
+        size = 1;
+    }
+    used += size + align;
+
+    usize start = (offset + align - 1) & ~(align - 1);
+    if (memory && start + size <= capacity) {
+        offset = start + size;
+        return memory + start;
+    }
+
+    // out of space this frame, reset() will make room for next time
+    usize spill_align = std::max(align, alignof(max_align_t));
+    void *p =
+        aligned_alloc(spill_align, (size + spill_align - 1) & ~(spill_align - 1));
+    spills.push_back(p);
+    return p;
+}
+
+void Arena::free(void *p, usize size) {
+    // only the newest allocation can be handed back, which is the common
+    // case for a vector that grows and is then dropped
+    u8 *bytes = static_cast<u8 *>(p);
+    if (memory && bytes >= memory && bytes + size == memory + offset) {
+        offset = bytes - memory;
+    }
+}
+
+void Arena::reset() {
+    high_water = std::max(high_water, used);
+
+    for (void *p : spills) {
+        ::free(p);
+    }
+    spills.clear();
+
+    if (high_water > capacity) {
+        ::free(memory);
+        capacity = std::max<usize>(ARENA_MIN_CAPACITY, high_water * 3 / 2);
+        capacity = (capacity + 63) & ~static_cast<usize>(63);
+        memory = static_cast<u8 *>(aligned_alloc(64, capacity));
+    }
+
+    offset = 0;
+    used = 0;
+}
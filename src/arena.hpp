@@ -0,0 +1,55 @@
+#pragma once
+
+#include "core.hpp"
+
+// linear allocator for data that lives for one frame. memory is handed out
+// by bumping an offset and released all at once by reset(). a frame that
+// outgrows the block spills into heap blocks, and the next reset() grows the
+// block so steady state frames never touch the heap
+struct Arena {
+    u8 *memory = nullptr;
+    usize capacity = 0;
+    usize offset = 0;
+
+    usize used = 0;       // bytes handed out this frame, spills included
+    usize high_water = 0; // largest used seen so far
+    std::vector<void *> spills;
+
+    Arena() = default;
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+    ~Arena();
+
+    void *alloc(usize size, usize align);
+    void free(void *p, usize size);
+    void reset();
+
+    template <typename T> T *alloc_array(usize count) {
+        return static_cast<T *>(alloc(count * sizeof(T), alignof(T)));
+    }
+};
+
+extern Arena frame_arena;
+
+template <typename T> struct ArenaAllocator {
+    using value_type = T;
+
+    Arena *arena;
+
+    ArenaAllocator(Arena &arena) : arena(&arena) {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+
+    T *allocate(usize n) { return arena->alloc_array<T>(n); }
+
+    void deallocate(T *p, usize n) { arena->free(p, n * sizeof(T)); }
+
+    template <typename U> bool operator==(const ArenaAllocator<U> &other) const {
+        return arena == other.arena;
+    }
+};
+
+// vector whose storage is only valid until its arena is reset, reassign it
+// after every reset
+template <typename T> using ArenaVector = std::vector<T, ArenaAllocator<T>>;
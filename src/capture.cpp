@@ -0,0 +1,163 @@
+#include "capture.hpp"
+
+#include <condition_variable>
+#include <mutex>
+
+CaptureStats capture_stats;
+
+struct Capture {
+    std::vector<u32> pixels; // argb, tightly packed
+    u32 width = 0;
+    u32 height = 0;
+    std::string path;
+    ImageFormat format = IMAGE_PPM;
+};
+
+static std::deque<Capture> queued_captures;
+static std::vector<std::vector<u32>> capture_pool;
+static usize pooled_buffers = 0; // allocated, in the pool or queued
+static bool capture_stopping = false;
+static std::mutex capture_mutex;
+static std::condition_variable capture_condition;
+static std::thread capture_thread;
+
+static void capture_loop() {
+    std::vector<u8> encoded;
+
+    while (true) {
+        Capture capture;
+        {
+            std::unique_lock lock(capture_mutex);
+            capture_condition.wait(lock, [] {
+                return capture_stopping || !queued_captures.empty();
+            });
+            if (queued_captures.empty()) {
+                break;
+            }
+            capture = std::move(queued_captures.front());
+            queued_captures.pop_front();
+        }
+
+        u64 start = SDL_GetPerformanceCounter();
+        encode_image({capture.pixels.data(), capture.width, capture.height,
+                      capture.width},
+                     capture.format, encoded);
+        bool written = write_file(capture.path.c_str(), encoded);
+        f64 ms = (SDL_GetPerformanceCounter() - start) * 1000.0 /
+                 SDL_GetPerformanceFrequency();
+
+        std::lock_guard lock(capture_mutex);
+        capture_stats.failed += !written;
+        capture_stats.encode_ms += ms;
+        capture_pool.push_back(std::move(capture.pixels));
+        capture_condition.notify_all();
+    }
+}
+
+// a free buffer, a new one while the pool may still grow, or whichever is
+// written first
+static std::vector<u32> take_buffer(std::unique_lock<std::mutex> &lock) {
+    if (capture_pool.empty() && pooled_buffers < CAPTURE_POOL_SIZE) {
+        pooled_buffers++;
+        return {};
+    }
+    if (capture_pool.empty()) {
+        capture_stats.waits++;
+        capture_condition.wait(lock, [] { return !capture_pool.empty(); });
+    }
+
+    std::vector<u32> pixels = std::move(capture_pool.back());
+    capture_pool.pop_back();
+    return pixels;
+}
+
+// hands the copy function a buffer of width x height pixels to fill
+template <typename F>
+static void queue_capture(u32 width, u32 height, const char *path,
+                          ImageFormat format, F copy) {
+    Capture capture;
+    {
+        std::unique_lock lock(capture_mutex);
+        if (!capture_thread.joinable()) {
+            capture_stopping = false;
+            capture_thread = std::thread(capture_loop);
+        }
+        capture.pixels = take_buffer(lock);
+        capture_stats.captures++;
+    }
+
+    capture.pixels.resize(static_cast<usize>(width) * height);
+    copy(capture.pixels.data());
+    capture.width = width;
+    capture.height = height;
+    capture.path = path;
+    capture.format = format;
+
+    std::lock_guard lock(capture_mutex);
+    queued_captures.push_back(std::move(capture));
+    capture_condition.notify_all();
+}
+
+void capture_image(ImageView image, const char *path, ImageFormat format) {
+    queue_capture(image.width, image.height, path, format, [&](u32 *pixels) {
+        for (u32 y = 0; y < image.height; y++) {
+            const u32 *row = image.pixels + static_cast<usize>(y) * image.pitch;
+            std::copy(row, row + image.width, pixels + y * image.width);
+        }
+    });
+}
+
+// source column of every image column, for buffer width columns_width
+static std::vector<u32> columns;
+static u32 columns_width = 0;
+
+void capture_frame(Framebuffer &buffer, u32 width, u32 height,
+                   const char *path, ImageFormat format) {
+    // lazy clears have to be in the plane before it is read
+    buffer.resolve();
+
+    if (columns.size() != width || columns_width != buffer.width) {
+        columns.resize(width);
+        for (u32 x = 0; x < width; x++) {
+            columns[x] = static_cast<u64>(x) * buffer.width / width;
+        }
+        columns_width = buffer.width;
+    }
+
+    queue_capture(width, height, path, format, [&](u32 *pixels) {
+        for (u32 y = 0; y < height; y++) {
+            u32 row = static_cast<u64>(y) * buffer.height / height;
+            const u32 *source = &buffer.pixel(0, row);
+            u32 *destination = pixels + static_cast<usize>(y) * width;
+            for (u32 x = 0; x < width; x++) {
+                destination[x] = buffer.native(source[columns[x]]);
+            }
+        }
+    });
+}
+
+void finish_captures() {
+    {
+        std::lock_guard lock(capture_mutex);
+        if (!capture_thread.joinable()) {
+            return;
+        }
+        capture_stopping = true;
+    }
+    capture_condition.notify_all();
+    capture_thread.join();
+}
+
+void print_capture_stats() {
+    const CaptureStats &stats = capture_stats;
+    if (stats.captures == 0) {
+        return;
+    }
+
+    printf("capture: %llu images, %llu waited for a buffer, %llu failed, "
+           "%.2f ms to encode on average\n",
+           static_cast<unsigned long long>(stats.captures),
+           static_cast<unsigned long long>(stats.waits),
+           static_cast<unsigned long long>(stats.failed),
+           stats.encode_ms / stats.captures);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "core.hpp"
+#include "framebuffer.hpp"
+#include "image.hpp"
+
+// screenshots and frame dumps, written by a background thread. a capture
+// only copies the pixels into a pooled buffer, encoding and writing the
+// file happen later
+
+// copies in flight before a capture has to wait for one to be written
+#define CAPTURE_POOL_SIZE 8
+
+struct CaptureStats {
+    u64 captures = 0;
+    u64 waits = 0; // captures that found every buffer in use
+    u64 failed = 0;
+    f64 encode_ms = 0; // spent on the capture thread
+};
+
+extern CaptureStats capture_stats;
+
+// queue image to be written to path
+void capture_image(ImageView image, const char *path, ImageFormat format);
+// queue the finished frame in buffer, applying its pending clears. it is
+// scaled to width x height, nearest neighbour, when rendered smaller
+void capture_frame(Framebuffer &buffer, u32 width, u32 height,
+                   const char *path, ImageFormat format);
+
+// write everything queued and stop the capture thread
+void finish_captures();
+
+void print_capture_stats();
@@ -1,15 +1,26 @@
 #include "display.hpp"
 
+DisplayBackend display_backend = BACKEND_SDL;
+
 u32 window_width = 800;
 u32 window_height = 600;
+u32 output_width = 800;
+u32 output_height = 600;
 
 SDL_Window *window = NULL;
 SDL_Renderer *renderer = NULL;
 
-std::vector<u32> frame_buffer;
+Framebuffer frame_buffer;
 SDL_Texture *frame_buffer_texture = NULL;
 
 bool initialize_window() {
+    if (display_backend == BACKEND_OFFSCREEN) {
+        // sdl is only used for its timers, which need no init
+        output_width = window_width;
+        output_height = window_height;
+        return true;
+    }
+
     // Init SDL
     if (!SDL_Init(SDL_INIT_VIDEO)) {
         fprintf(stderr, "Error SDL_Init()\n");
@@ -19,23 +30,32 @@ bool initialize_window() {
     // Get all displays
     i32 count;
     SDL_DisplayID *ids = SDL_GetDisplays(&count);
+    if (!ids || count == 0) {
+        fprintf(stderr, "Error SDL_GetDisplays() no display %s\n",
+                SDL_GetError());
+        SDL_free(ids);
+        return false;
+    }
 
     // Pick first display
     SDL_DisplayID display = ids[0];
+    SDL_free(ids);
 
     // Query window capabilities
     const SDL_DisplayMode *display_mode = SDL_GetCurrentDisplayMode(display);
     if (!display_mode) {
         fprintf(stderr, "Error SDL_GetCurrentDisplayMode() %s\n",
                 SDL_GetError());
+        return false;
     }
     window_width = display_mode->w;
     window_height = display_mode->h;
+    output_width = window_width;
+    output_height = window_height;
 
     // Create SDL window
     SDL_WindowFlags flags = SDL_WINDOW_BORDERLESS;
-    SDL_Window *window =
-        SDL_CreateWindow(NULL, window_width, window_height, flags);
+    window = SDL_CreateWindow(NULL, window_width, window_height, flags);
     if (!window) {
         fprintf(stderr, "Error SDL_CreateWindow() %s", SDL_GetError());
         return false;
@@ -53,37 +73,53 @@ bool initialize_window() {
 }
 
 void destroy_window() {
-    SDL_DestroyRenderer(renderer);
-    SDL_DestroyWindow(window);
+    if (display_backend == BACKEND_SDL) {
+        SDL_DestroyRenderer(renderer);
+        SDL_DestroyWindow(window);
+    }
     SDL_Quit();
 }
 
 void draw_pixel(const u32 x, const u32 y, const u32 color) {
-    assert(x >= 0 && y >= 0 && x <= window_width && y <= window_height);
+    // lines and flat triangles are not clipped, which any frame size other
+    // than the display's runs into. negative coordinates wrap around here
+    if (x >= window_width || y >= window_height || frame_buffer.kept(x, y)) {
+        return;
+    }
 
-    frame_buffer[x + y * window_width] = color;
+    frame_buffer.touch(x, y);
+    frame_buffer.pixel(x, y) = frame_buffer.native(color);
 }
 
 void draw_grid(const u32 grid_x_spacing, const u32 grid_y_spacing) {
-    // const u32 dot_x_spacing = grid_x_spacing / 2;
-    // const u32 dot_y_spacing = grid_y_spacing / 2;
-    const u32 color = 0xff333333;
-
-    /*
-    for (size_t y = dot_y_spacing; y < window_height; y += dot_y_spacing * 2) {
-      for (size_t x = dot_x_spacing; x < window_width; x += dot_x_spacing * 2) {
-        frame_buffer[x + y * window_width] = color;
-      }
+    const u32 color = frame_buffer.native(0xff333333);
+
+    // the grid lives in the background layer and is restored by every
+    // clear, it is only redrawn when it would come out different. each
+    // framebuffer keeps its own layer, so the parameters are stored with it
+    const u64 key = static_cast<u64>(grid_x_spacing & 0xffff) << 48 |
+                    static_cast<u64>(grid_y_spacing & 0xffff) << 32 |
+                    frame_buffer.clear_color;
+    if (frame_buffer.use_background && frame_buffer.background_key == key) {
+        return;
     }
-    */
 
+    // whole rows for horizontal lines, then every x spacing on the rest
     for (size_t y = 0; y < window_height; y++) {
-        for (size_t x = 0; x < window_width; x++) {
-            if (x % grid_x_spacing == 0 || y % grid_y_spacing == 0) {
-                frame_buffer[x + y * window_width] = color;
-            }
+        u32 *row = frame_buffer.background + y * frame_buffer.pitch;
+        if (y % grid_y_spacing == 0) {
+            std::fill(row, row + window_width, color);
+            continue;
+        }
+
+        std::fill(row, row + window_width, frame_buffer.clear_color);
+        for (size_t x = 0; x < window_width; x += grid_x_spacing) {
+            row[x] = color;
         }
     }
+
+    frame_buffer.background_key = key;
+    frame_buffer.set_background();
 }
 
 void draw_rect(i32 x, i32 y, u32 width, u32 height, u32 color) {
@@ -152,16 +188,65 @@ void draw_line_b(i32 x0, i32 y0, i32 x1, i32 y1, u32 color) {
     }
 }
 
-void render_frame_buffer() {
-    SDL_UpdateTexture(frame_buffer_texture, NULL, frame_buffer.data(),
-                      window_width * sizeof(u32));
-    SDL_RenderTexture(renderer, frame_buffer_texture, NULL, NULL);
+SDL_PixelFormat native_texture_format() {
+    SDL_PropertiesID properties = SDL_GetRendererProperties(renderer);
+    const SDL_PixelFormat *formats =
+        static_cast<const SDL_PixelFormat *>(SDL_GetPointerProperty(
+            properties, SDL_PROP_RENDERER_TEXTURE_FORMATS_POINTER, NULL));
+
+    // the renderer lists its preferred formats first, take the first one
+    // we can draw in
+    for (usize i = 0; formats && formats[i] != SDL_PIXELFORMAT_UNKNOWN; i++) {
+        switch (formats[i]) {
+        case SDL_PIXELFORMAT_ARGB8888:
+        case SDL_PIXELFORMAT_XRGB8888:
+        case SDL_PIXELFORMAT_ABGR8888:
+        case SDL_PIXELFORMAT_XBGR8888:
+            return formats[i];
+        default:
+            break;
+        }
+    }
+    return SDL_PIXELFORMAT_ARGB8888;
 }
 
-void clear_frame_buffer(u32 color) {
-    for (size_t y = 0; y < window_height; y++) {
-        for (size_t x = 0; x < window_width; x++) {
-            frame_buffer[x + y * window_width] = color;
-        }
+bool lock_frame_buffer(Framebuffer &buffer) {
+    void *pixels;
+    i32 pitch;
+    if (!SDL_LockTexture(buffer.texture, NULL, &pixels, &pitch)) {
+        fprintf(stderr, "Error SDL_LockTexture() %s\n", SDL_GetError());
+        return false;
     }
+
+    buffer.attach_color(static_cast<u32 *>(pixels), pitch / sizeof(u32));
+    return true;
 }
+
+void render_locked_frame_buffer(Framebuffer &buffer) {
+    // cleared tiles nothing was drawn to are stored now, then the texture
+    // already holds the whole frame
+    buffer.resolve();
+    SDL_UnlockTexture(buffer.texture);
+    SDL_FRect source = {0, 0, static_cast<f32>(buffer.width),
+                        static_cast<f32>(buffer.height)};
+    SDL_RenderTexture(renderer, buffer.texture, &source, NULL);
+}
+
+void render_frame_buffer(Framebuffer &buffer) {
+    // only tiles that changed since the last upload are sent
+    buffer.flush_dirty([&](u32 x, u32 y, u32 width, u32 height) {
+        SDL_Rect rect = {static_cast<i32>(x), static_cast<i32>(y),
+                         static_cast<i32>(width), static_cast<i32>(height)};
+        const u32 *pixels = &buffer.pixel(x, y);
+        SDL_UpdateTexture(frame_buffer_texture, &rect, pixels,
+                          buffer.pitch * sizeof(u32));
+    });
+    // the frame may be smaller than the texture, the renderer scales it up
+    SDL_FRect source = {0, 0, static_cast<f32>(buffer.width),
+                        static_cast<f32>(buffer.height)};
+    SDL_RenderTexture(renderer, frame_buffer_texture, &source, NULL);
+}
+
+void clear_frame_buffer(u32 color) { frame_buffer.clear(color); }
+
+void clear_depth_buffer() { frame_buffer.clear_depth(); }
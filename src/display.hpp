@@ -1,24 +1,50 @@
 #pragma once
 
 #include "core.hpp"
+#include "framebuffer.hpp"
 
 #define TARGET_FRAMETIME 1000.0 / 60.0
 
+enum DisplayBackend {
+    BACKEND_SDL,       // fullscreen window on the first display
+    BACKEND_OFFSCREEN, // no window, frames go to offscreen_target
+};
+
+extern DisplayBackend display_backend;
+
+// frame size, the sdl backend replaces it with the display mode. with
+// dynamic resolution this is the render size, which is scaled up to the
+// output size when presented
 extern u32 window_width;
 extern u32 window_height;
+extern u32 output_width;
+extern u32 output_height;
 
 extern SDL_Window *window;
 extern SDL_Renderer *renderer;
 
-extern std::vector<u32> frame_buffer;
+// color plus z / w per pixel, 1 is the far plane
+extern Framebuffer frame_buffer;
 extern SDL_Texture *frame_buffer_texture;
 
 bool initialize_window();
 void destroy_window();
 void draw_pixel(u32 x, u32 y, u32 color);
+// grid over clear color, kept in the background layer of frame_buffer
 void draw_grid(u32 grid_x_spacing, u32 grid_y_spacing);
 void draw_rect(i32 x, i32 y, u32 width, u32 height, u32 color);
 void draw_line(i32 x0, i32 y0, i32 x1, i32 y1, u32 color);
 void draw_line_b(i32 x0, i32 y0, i32 x1, i32 y1, u32 color);
-void render_frame_buffer();
+// 32 bit format preferred by the renderer that draw_pixel() can write
+SDL_PixelFormat native_texture_format();
+
+// lock buffer.texture and draw into it directly from now on
+bool lock_frame_buffer(Framebuffer &buffer);
+// unlock buffer.texture and draw it, no pixels are copied
+void render_locked_frame_buffer(Framebuffer &buffer);
+
+// upload the dirty tiles of buffer and draw the texture, on the thread that
+// owns the renderer
+void render_frame_buffer(Framebuffer &buffer);
 void clear_frame_buffer(u32 color);
+void clear_depth_buffer();
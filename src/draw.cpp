@@ -0,0 +1,416 @@
+#include "draw.hpp"
+#include "display.hpp"
+#include "light.hpp"
+
+#include <immintrin.h>
+
+ArenaVector<triangle> triangles_to_render{frame_arena};
+ArenaVector<DepthKey> render_order{frame_arena};
+
+Vec3 camera_position = {0, 0, 0};
+Mat4x4f proj_matrix;
+
+Vec3 light = {0.0, 0.0, 1.0};
+bool cull_mode = true;
+
+u32 light_apply_intensity(u32 color, f32 factor) {
+    if (factor < 0) {
+        factor = 0;
+    }
+    if (factor > 1) {
+        factor = 1;
+    }
+
+    u32 a = (color & 0xff000000);
+    u32 r = (color & 0x00ff0000) * factor;
+    u32 g = (color & 0x0000ff00) * factor;
+    u32 b = (color & 0x000000ff) * factor;
+
+    u32 new_color = a | (r & 0x00ff0000) | (g & 0x0000ff00) | (b & 0x000000ff);
+
+    return new_color;
+}
+
+// view frustum of proj_matrix, camera looks down +z
+struct Frustum {
+    f32 near;
+    f32 far;
+    f32 x_scale; // side planes are x_scale * x = z and y_scale * y = z
+    f32 y_scale;
+    f32 x_len; // length of the side plane normals
+    f32 y_len;
+};
+
+static Frustum frustum_from_projection(const Mat4x4f &m) {
+    Frustum f;
+    f.near = -m[2][3] / m[2][2];
+    f.far = m[2][3] / (1 - m[2][2]);
+    f.x_scale = m[0][0];
+    f.y_scale = m[1][1];
+    f.x_len = sqrt(f.x_scale * f.x_scale + 1);
+    f.y_len = sqrt(f.y_scale * f.y_scale + 1);
+    return f;
+}
+
+static bool sphere_visible(const Frustum &f, Vec3 c, f32 r) {
+    if (c.z + r < f.near || c.z - r > f.far) {
+        return false;
+    }
+    if (fabs(c.x) * f.x_scale - c.z > r * f.x_len) {
+        return false;
+    }
+    if (fabs(c.y) * f.y_scale - c.z > r * f.y_len) {
+        return false;
+    }
+    return true;
+}
+
+// frustum cull the mesh bounding sphere of every instance, 8 instances per
+// iteration with one register per matrix element
+static void cull_instances(const Mesh &mesh,
+                           std::span<const Mat4x4f> transforms,
+                           ArenaVector<u32> &visible) {
+    const Frustum f = frustum_from_projection(proj_matrix);
+    const Vec3 c = mesh.sphere_center;
+
+    visible.clear();
+
+    const __m256 center_x = _mm256_set1_ps(c.x);
+    const __m256 center_y = _mm256_set1_ps(c.y);
+    const __m256 center_z = _mm256_set1_ps(c.z);
+    const __m256 radius = _mm256_set1_ps(mesh.sphere_radius);
+    const __m256 camera_x = _mm256_set1_ps(camera_position.x);
+    const __m256 camera_y = _mm256_set1_ps(camera_position.y);
+    const __m256 camera_z = _mm256_set1_ps(camera_position.z);
+    const __m256 near = _mm256_set1_ps(f.near);
+    const __m256 far = _mm256_set1_ps(f.far);
+    const __m256 x_scale = _mm256_set1_ps(f.x_scale);
+    const __m256 y_scale = _mm256_set1_ps(f.y_scale);
+    const __m256 x_len = _mm256_set1_ps(f.x_len);
+    const __m256 y_len = _mm256_set1_ps(f.y_len);
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+
+    usize k = 0;
+    for (; k + 8 <= transforms.size(); k += 8) {
+        const Mat4x4f *t = &transforms[k];
+
+        __m256 m[3][4];
+        for (usize row = 0; row < 3; row++) {
+            for (usize col = 0; col < 4; col++) {
+                m[row][col] = _mm256_setr_ps(
+                    t[0][row][col], t[1][row][col], t[2][row][col],
+                    t[3][row][col], t[4][row][col], t[5][row][col],
+                    t[6][row][col], t[7][row][col]);
+            }
+        }
+
+        __m256 world[3];
+        for (usize row = 0; row < 3; row++) {
+            __m256 v = _mm256_mul_ps(m[row][0], center_x);
+            v = _mm256_add_ps(v, _mm256_mul_ps(m[row][1], center_y));
+            v = _mm256_add_ps(v, _mm256_mul_ps(m[row][2], center_z));
+            world[row] = _mm256_add_ps(v, m[row][3]);
+        }
+        __m256 x = _mm256_sub_ps(world[0], camera_x);
+        __m256 y = _mm256_sub_ps(world[1], camera_y);
+        __m256 z = _mm256_sub_ps(world[2], camera_z);
+
+        // radius grows with the largest axis scale
+        __m256 scale_squared = _mm256_setzero_ps();
+        for (usize col = 0; col < 3; col++) {
+            __m256 s = _mm256_mul_ps(m[0][col], m[0][col]);
+            s = _mm256_add_ps(s, _mm256_mul_ps(m[1][col], m[1][col]));
+            s = _mm256_add_ps(s, _mm256_mul_ps(m[2][col], m[2][col]));
+            scale_squared = _mm256_max_ps(scale_squared, s);
+        }
+        __m256 r = _mm256_mul_ps(radius, _mm256_sqrt_ps(scale_squared));
+
+        __m256 inside = _mm256_cmp_ps(_mm256_add_ps(z, r), near, _CMP_GE_OQ);
+        inside = _mm256_and_ps(
+            inside, _mm256_cmp_ps(_mm256_sub_ps(z, r), far, _CMP_LE_OQ));
+
+        __m256 side_x = _mm256_sub_ps(
+            _mm256_mul_ps(_mm256_andnot_ps(sign, x), x_scale), z);
+        inside = _mm256_and_ps(
+            inside,
+            _mm256_cmp_ps(side_x, _mm256_mul_ps(r, x_len), _CMP_LE_OQ));
+
+        __m256 side_y = _mm256_sub_ps(
+            _mm256_mul_ps(_mm256_andnot_ps(sign, y), y_scale), z);
+        inside = _mm256_and_ps(
+            inside,
+            _mm256_cmp_ps(side_y, _mm256_mul_ps(r, y_len), _CMP_LE_OQ));
+
+        u32 mask = _mm256_movemask_ps(inside);
+        while (mask) {
+            visible.push_back(k + std::countr_zero(mask));
+            mask &= mask - 1;
+        }
+    }
+
+    // remaining instances one at a time
+    for (; k < transforms.size(); k++) {
+        const Mat4x4f &t = transforms[k];
+
+        Vec3 world = Vec3{t * Vec4{c}} - camera_position;
+
+        f32 scale_squared = 0;
+        for (usize col = 0; col < 3; col++) {
+            scale_squared =
+                std::max(scale_squared, t[0][col] * t[0][col] +
+                                            t[1][col] * t[1][col] +
+                                            t[2][col] * t[2][col]);
+        }
+
+        if (sphere_visible(f, world,
+                           mesh.sphere_radius * sqrt(scale_squared))) {
+            visible.push_back(k);
+        }
+    }
+}
+
+// rotation, translation and uniform scale only, normal_matrix() of such a
+// matrix keeps normals unit length
+static bool is_similarity(const Mat4x4f &m) {
+    f32 gram[3][3];
+    for (usize i = 0; i < 3; i++) {
+        for (usize j = 0; j < 3; j++) {
+            gram[i][j] = m[0][i] * m[0][j] + m[1][i] * m[1][j] +
+                         m[2][i] * m[2][j];
+        }
+    }
+
+    const f32 epsilon = 1e-4 * gram[0][0];
+    return fabs(gram[1][1] - gram[0][0]) <= epsilon &&
+           fabs(gram[2][2] - gram[0][0]) <= epsilon &&
+           fabs(gram[0][1]) <= epsilon && fabs(gram[0][2]) <= epsilon &&
+           fabs(gram[1][2]) <= epsilon;
+}
+
+// rotate a batch of normals, renormalizing only when the matrix does not
+// preserve length
+static void transform_normals(const Mat3x3f &m, std::span<const Vec3> in,
+                              std::span<Vec3> out, bool renormalize) {
+    for (usize i = 0; i < in.size(); i++) {
+        out[i] = m * in[i];
+    }
+
+    if (renormalize) {
+        for (usize i = 0; i < in.size(); i++) {
+            f32 length = len(out[i]);
+            if (length > 0) {
+                out[i] = out[i] / length;
+            }
+        }
+    }
+}
+
+// lightmap is null for meshes lit every frame
+static void draw_instances(const Mesh &mesh,
+                           std::span<const Mat4x4f> transforms,
+                           std::span<const u32> colors,
+                           const Lightmap *lightmap) {
+    if (transforms.empty() || colors.empty()) {
+        return;
+    }
+    assert(colors.size() == 1 || colors.size() == transforms.size());
+
+    usize index_count = mesh_index_count(mesh);
+    usize vertex_count = mesh_vertex_count(mesh);
+
+    // decode the shared mesh data once for all instances
+    ArenaVector<Vec4> mesh_positions(vertex_count, frame_arena);
+    for (usize v = 0; v < vertex_count; v++) {
+        mesh_positions[v] = Vec4{mesh_vertex(mesh, v)};
+    }
+
+    ArenaVector<u32> mesh_indices(index_count, frame_arena);
+    ArenaVector<Vec2> mesh_uvs(index_count, frame_arena);
+    for (usize i = 0; i < index_count; i++) {
+        mesh_indices[i] = mesh_index(mesh, i);
+        mesh_uvs[i] = mesh_uv(mesh, mesh_uv_index(mesh, i));
+    }
+
+    ArenaVector<u32> visible_instances(frame_arena);
+    visible_instances.reserve(transforms.size());
+    cull_instances(mesh, transforms, visible_instances);
+
+    // worst case every face of every visible instance survives
+    triangles_to_render.reserve(triangles_to_render.size() +
+                                visible_instances.size() * index_count / 3);
+
+    // quantized positions are dequantized by the same matrix multiply
+    const Mat4x4f dequantize = dequantize_matrix(mesh);
+
+    ArenaVector<Vec4> transformed_positions(vertex_count, frame_arena);
+    ArenaVector<Vec3> face_normals(mesh.face_normal_buffer.size(),
+                                   frame_arena);
+
+    // gouraud and per pixel shading use the vn normals when every face
+    // has them, otherwise the face normal at each corner
+    const bool smooth = shading_mode != SHADING_FLAT;
+    const bool has_vertex_normals =
+        !mesh.normal_buffer.empty() &&
+        mesh.normal_index_buffer.size() == index_count;
+    ArenaVector<Vec3> vertex_normals(frame_arena);
+    if (smooth && has_vertex_normals) {
+        vertex_normals.resize(mesh.normal_buffer.size());
+    }
+
+    for (u32 k : visible_instances) {
+        const Mat4x4f vertex_matrix = dequantize * transforms[k];
+        const u32 instance_color = colors.size() == 1 ? colors[0] : colors[k];
+
+        // transform each vertex once, faces then share the results
+        for (usize v = 0; v < vertex_count; v++) {
+            transformed_positions[v] = vertex_matrix * mesh_positions[v];
+        }
+
+        // rotate the load time face normals, the quantization scale only
+        // applies to positions so the plain transform is used
+        const Mat3x3f instance_normal_matrix = normal_matrix(transforms[k]);
+        const bool renormalize = !is_similarity(transforms[k]);
+        transform_normals(instance_normal_matrix, mesh.face_normal_buffer,
+                          face_normals, renormalize);
+        if (!vertex_normals.empty()) {
+            transform_normals(instance_normal_matrix, mesh.normal_buffer,
+                              vertex_normals, true);
+        }
+
+        for (usize i = 0; i + 2 < index_count; i += 3) {
+            Vec2 face_uv[3] = {mesh_uvs[i], mesh_uvs[i + 1], mesh_uvs[i + 2]};
+
+            Vec4 transformed_vertices[3] = {
+                transformed_positions[mesh_indices[i]],
+                transformed_positions[mesh_indices[i + 1]],
+                transformed_positions[mesh_indices[i + 2]],
+            };
+
+            Vec3 a = transformed_vertices[0];
+            Vec3 b = transformed_vertices[1];
+            Vec3 c = transformed_vertices[2];
+
+            Vec3 normal = face_normals[i / 3];
+
+            // vector between a and camera
+            Vec3 cam_ray = camera_position - a;
+
+            // backface culling
+            if (cull_mode) {
+                float alignment = dot(normal, cam_ray);
+                if (alignment < 0) {
+                    continue;
+                }
+            }
+
+            f32 avg_depth = (a.z + b.z + c.z) / 3;
+
+            Vec4 proj_points[3];
+            for (uint32_t j = 0; j < 3; j++) {
+                proj_points[j] = project(proj_matrix, transformed_vertices[j]);
+
+                // invert in y
+                proj_points[j].y *= -1;
+                //
+                // scale into view
+                proj_points[j].x *= window_width / 2.0;
+                proj_points[j].y *= window_height / 2.0;
+
+                // translate to middle of screen
+                proj_points[j].x += window_width / 2.0;
+                proj_points[j].y += window_height / 2.0;
+            }
+
+            triangle projected_triangle = {
+                .points = {proj_points[0], proj_points[1], proj_points[2]},
+                .uv = {face_uv[0], face_uv[1], face_uv[2]},
+                .avg_depth = avg_depth,
+                .base_color = instance_color,
+                .world = {a, b, c},
+                .normals = {normal, normal, normal},
+            };
+
+            if (!vertex_normals.empty()) {
+                for (usize j = 0; j < 3; j++) {
+                    projected_triangle.normals[j] =
+                        vertex_normals[mesh.normal_index_buffer[i + j]];
+                }
+            }
+
+            // baked lighting is fetched per pixel instead
+            if (lightmap) {
+                projected_triangle.color = instance_color;
+                projected_triangle.lightmap = lightmap;
+                for (usize j = 0; j < 3; j++) {
+                    projected_triangle.lightmap_uv[j] =
+                        lightmap->uv_buffer[i + j];
+                }
+                triangles_to_render.push_back(projected_triangle);
+                continue;
+            }
+
+            // flat shading lights the centroid, with the light list of the
+            // tile its projection falls in
+            Vec3 center = (a + b + c) / 3;
+            Vec2 center_pixel = (Vec2{proj_points[0]} + Vec2{proj_points[1]} +
+                                 Vec2{proj_points[2]}) /
+                                3;
+            projected_triangle.color = light_apply_color(
+                instance_color, shade_point(center, normal, center_pixel.x,
+                                            center_pixel.y));
+
+            if (shading_mode == SHADING_GOURAUD) {
+                for (usize j = 0; j < 3; j++) {
+                    Vec3 intensity = shade_point(
+                        projected_triangle.world[j],
+                        projected_triangle.normals[j], proj_points[j].x,
+                        proj_points[j].y);
+                    projected_triangle.colors[j] =
+                        light_apply_color(instance_color, intensity);
+                }
+            }
+
+            triangles_to_render.push_back(projected_triangle);
+        }
+    }
+}
+
+void draw_mesh_instanced(const Mesh &mesh, std::span<const Mat4x4f> transforms,
+                         std::span<const u32> colors) {
+    draw_instances(mesh, transforms, colors, nullptr);
+}
+
+void draw_mesh(const Mesh &mesh, const Mat4x4f &transform, u32 color) {
+    draw_mesh_instanced(mesh, {&transform, 1}, {&color, 1});
+}
+
+void draw_mesh_lightmapped(const Mesh &mesh, const Mat4x4f &transform,
+                           u32 color, const Lightmap &lightmap) {
+    draw_instances(mesh, {&transform, 1}, {&color, 1}, &lightmap);
+}
+
+void begin_frame() {
+    frame_arena.reset();
+
+    // containers from the last frame point into the arena, start over
+    triangles_to_render = ArenaVector<triangle>(frame_arena);
+    render_order = ArenaVector<DepthKey>(frame_arena);
+    light_grid.lights = {};
+    light_grid.offsets = ArenaVector<u32>(frame_arena);
+    light_grid.indices = ArenaVector<u32>(frame_arena);
+}
+
+void sort_triangles() {
+    usize n = triangles_to_render.size();
+
+    render_order.resize(n);
+    ArenaVector<DepthKey> render_order_scratch(n, frame_arena);
+    for (usize i = 0; i < n; i++) {
+        render_order[i] = {
+            .key = depth_key_back_to_front(triangles_to_render[i].avg_depth),
+            .index = static_cast<u32>(i),
+        };
+    }
+
+    radix_sort(render_order, render_order_scratch);
+}
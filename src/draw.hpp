@@ -0,0 +1,42 @@
+#pragma once
+
+#include "arena.hpp"
+#include "core.hpp"
+#include "matrix.hpp"
+#include "mesh.hpp"
+#include "sort.hpp"
+#include "lightmap.hpp"
+#include "triangle.hpp"
+#include "vector.hpp"
+
+// per frame triangle lists, allocated from frame_arena
+extern ArenaVector<triangle> triangles_to_render;
+// triangles_to_render indices in painter's order, filled by sort_triangles()
+extern ArenaVector<DepthKey> render_order;
+
+extern Vec3 camera_position;
+extern Mat4x4f proj_matrix;
+
+extern Vec3 light;
+extern bool cull_mode;
+
+u32 light_apply_intensity(u32 color, f32 factor);
+
+// transform, cull, light and project every instance of mesh into
+// triangles_to_render. colors holds one color per instance, or a single
+// color shared by all of them
+void draw_mesh_instanced(const Mesh &mesh, std::span<const Mat4x4f> transforms,
+                         std::span<const u32> colors);
+
+void draw_mesh(const Mesh &mesh, const Mat4x4f &transform, u32 color);
+
+// static mesh whose lighting was baked at transform by bake_lightmap(), no
+// lighting is evaluated per frame
+void draw_mesh_lightmapped(const Mesh &mesh, const Mat4x4f &transform,
+                           u32 color, const Lightmap &lightmap);
+
+// release last frame's transient data and start empty triangle lists
+void begin_frame();
+
+// order triangles_to_render back to front into render_order
+void sort_triangles();
@@ -0,0 +1,262 @@
+#include "framebuffer.hpp"
+
+#define FRAMEBUFFER_ALIGN 64
+
+// whole cache lines, aligned_alloc wants a multiple of the alignment
+static void *allocate_plane(u32 pitch, u32 height) {
+    usize bytes = static_cast<usize>(pitch) * height * sizeof(u32);
+    bytes = (bytes + FRAMEBUFFER_ALIGN - 1) & ~(FRAMEBUFFER_ALIGN - 1);
+    return aligned_alloc(FRAMEBUFFER_ALIGN, bytes);
+}
+
+Framebuffer::~Framebuffer() {
+    if (owns_color) {
+        ::free(color);
+    }
+    ::free(depth);
+    ::free(background);
+}
+
+void Framebuffer::resize(u32 new_width, u32 new_height) {
+    ::free(depth);
+    ::free(background);
+
+    width = new_width;
+    height = new_height;
+
+    if (owns_color) {
+        ::free(color);
+
+        // both planes use 4 byte pixels, pad rows to whole cache lines
+        const u32 pixels_per_line = FRAMEBUFFER_ALIGN / sizeof(u32);
+        pitch = (width + pixels_per_line - 1) & ~(pixels_per_line - 1);
+        color = static_cast<u32 *>(allocate_plane(pitch, height));
+    }
+
+    depth = static_cast<f32 *>(allocate_plane(pitch, height));
+    background = static_cast<u32 *>(allocate_plane(pitch, height));
+    use_background = false;
+
+    tiles_x = (width + FRAMEBUFFER_TILE_SIZE - 1) / FRAMEBUFFER_TILE_SIZE;
+    tiles_y = (height + FRAMEBUFFER_TILE_SIZE - 1) / FRAMEBUFFER_TILE_SIZE;
+    usize tile_count = tiles_x * tiles_y;
+    dirty.assign(tile_count, 1);
+    written.assign(tile_count, 0);
+    clear_pending.assign(tile_count, 1);
+    depth_written.assign(tile_count, 0);
+    depth_pending.assign(tile_count, 1);
+    tile_hash.assign(tile_count, 0);
+    keep.assign(tile_count, 0);
+}
+
+void Framebuffer::attach_color(u32 *pixels, u32 new_pitch) {
+    // depth and background follow the color rows
+    if (new_pitch != pitch) {
+        ::free(depth);
+        ::free(background);
+        depth = static_cast<f32 *>(allocate_plane(new_pitch, height));
+        background = static_cast<u32 *>(allocate_plane(new_pitch, height));
+        use_background = false;
+        pitch = new_pitch;
+        std::fill(depth_written.begin(), depth_written.end(), 0);
+        std::fill(depth_pending.begin(), depth_pending.end(), 1);
+    }
+
+    if (owns_color) {
+        ::free(color);
+    }
+    color = pixels;
+    owns_color = false;
+
+    // the next clear() has to store every tile
+    std::fill(written.begin(), written.end(), 1);
+    std::fill(dirty.begin(), dirty.end(), 1);
+    std::fill(tile_hash.begin(), tile_hash.end(), 0);
+}
+
+void Framebuffer::detach_color() {
+    texture = nullptr;
+    if (owns_color) {
+        return;
+    }
+
+    color = nullptr;
+    owns_color = true;
+    resize(width, height);
+}
+
+void Framebuffer::swap(Framebuffer &other) {
+    std::swap(width, other.width);
+    std::swap(height, other.height);
+    std::swap(pitch, other.pitch);
+    std::swap(color, other.color);
+    std::swap(depth, other.depth);
+    std::swap(background, other.background);
+    std::swap(use_background, other.use_background);
+    std::swap(background_key, other.background_key);
+    std::swap(texture, other.texture);
+    std::swap(owns_color, other.owns_color);
+    std::swap(swap_red_blue, other.swap_red_blue);
+    std::swap(tiles_x, other.tiles_x);
+    std::swap(tiles_y, other.tiles_y);
+    dirty.swap(other.dirty);
+    tile_hash.swap(other.tile_hash);
+    keep.swap(other.keep);
+    written.swap(other.written);
+    clear_pending.swap(other.clear_pending);
+    std::swap(clear_color, other.clear_color);
+    depth_written.swap(other.depth_written);
+    depth_pending.swap(other.depth_pending);
+}
+
+// rows of a tile start 64 pixel aligned inside 64 byte aligned rows, so
+// whole 8 pixel groups can be streamed and only the right edge of the
+// frame needs a scalar tail
+template <typename T>
+static void fill_rows(T *plane, u32 pitch, Framebuffer::TileRect rect, T value,
+                      bool streaming) {
+    static_assert(sizeof(T) == sizeof(u32));
+
+    u32 count = rect.x1 - rect.x0;
+    const __m256i fill = _mm256_set1_epi32(std::bit_cast<u32>(value));
+
+    for (u32 y = rect.y0; y < rect.y1; y++) {
+        T *row = plane + rect.x0 + static_cast<usize>(y) * pitch;
+
+        u32 x = 0;
+        if (streaming) {
+            for (; x + 8 <= count; x += 8) {
+                _mm256_stream_si256(reinterpret_cast<__m256i *>(row + x), fill);
+            }
+        }
+        std::fill(row + x, row + count, value);
+    }
+}
+
+// same layout rules as fill_rows(), with source rows from the background
+static void copy_rows(u32 *plane, const u32 *source, u32 pitch,
+                      Framebuffer::TileRect rect, bool streaming) {
+    u32 count = rect.x1 - rect.x0;
+
+    for (u32 y = rect.y0; y < rect.y1; y++) {
+        usize offset = rect.x0 + static_cast<usize>(y) * pitch;
+        u32 *row = plane + offset;
+        const u32 *source_row = source + offset;
+
+        u32 x = 0;
+        if (streaming) {
+            for (; x + 8 <= count; x += 8) {
+                __m256i v = _mm256_load_si256(
+                    reinterpret_cast<const __m256i *>(source_row + x));
+                _mm256_stream_si256(reinterpret_cast<__m256i *>(row + x), v);
+            }
+        }
+        std::copy(source_row + x, source_row + count, row + x);
+    }
+}
+
+void Framebuffer::fill_color_tile(usize tile, bool streaming) {
+    // locked texture memory need not be aligned like our own planes
+    streaming = streaming && pitch % 8 == 0 &&
+                reinterpret_cast<uintptr_t>(color) % 32 == 0;
+
+    if (use_background) {
+        copy_rows(color, background, pitch, tile_rect(tile), streaming);
+    } else {
+        fill_rows(color, pitch, tile_rect(tile), clear_color, streaming);
+    }
+    clear_pending[tile] = 0;
+}
+
+void Framebuffer::fill_depth_tile(usize tile) {
+    fill_rows(depth, pitch, tile_rect(tile), 1.0f, false);
+    depth_pending[tile] = 0;
+}
+
+void Framebuffer::prepare_depth(i32 x0, i32 y0, i32 x1, i32 y1) {
+    x0 = std::max(x0, 0);
+    y0 = std::max(y0, 0);
+    x1 = std::min(x1, static_cast<i32>(width) - 1);
+    y1 = std::min(y1, static_cast<i32>(height) - 1);
+    if (x0 > x1 || y0 > y1) {
+        return;
+    }
+
+    for (i32 ty = y0 / FRAMEBUFFER_TILE_SIZE; ty <= y1 / FRAMEBUFFER_TILE_SIZE;
+         ty++) {
+        for (i32 tx = x0 / FRAMEBUFFER_TILE_SIZE;
+             tx <= x1 / FRAMEBUFFER_TILE_SIZE; tx++) {
+            usize tile = ty * tiles_x + tx;
+            if (depth_pending[tile]) {
+                fill_depth_tile(tile);
+            }
+            depth_written[tile] = 1;
+        }
+    }
+}
+
+bool Framebuffer::all_kept(i32 x0, i32 y0, i32 x1, i32 y1) const {
+    x0 = std::max(x0, 0);
+    y0 = std::max(y0, 0);
+    x1 = std::min(x1, static_cast<i32>(width) - 1);
+    y1 = std::min(y1, static_cast<i32>(height) - 1);
+    if (x0 > x1 || y0 > y1) {
+        return false;
+    }
+
+    for (i32 ty = y0 / FRAMEBUFFER_TILE_SIZE; ty <= y1 / FRAMEBUFFER_TILE_SIZE;
+         ty++) {
+        for (i32 tx = x0 / FRAMEBUFFER_TILE_SIZE;
+             tx <= x1 / FRAMEBUFFER_TILE_SIZE; tx++) {
+            if (!keep[ty * tiles_x + tx]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void Framebuffer::clear(u32 new_color) {
+    new_color = native(new_color);
+    if (new_color != clear_color) {
+        std::fill(written.begin(), written.end(), 1);
+        clear_color = new_color;
+    }
+
+    for (usize tile = 0; tile < written.size(); tile++) {
+        if (written[tile] && !keep[tile]) {
+            written[tile] = 0;
+            clear_pending[tile] = 1;
+            dirty[tile] = 1;
+        }
+    }
+}
+
+void Framebuffer::clear_depth() {
+    for (usize tile = 0; tile < depth_written.size(); tile++) {
+        if (depth_written[tile]) {
+            depth_written[tile] = 0;
+            depth_pending[tile] = 1;
+        }
+    }
+}
+
+void Framebuffer::set_background() {
+    use_background = true;
+
+    // every tile now has to come from the layer
+    std::fill(tile_hash.begin(), tile_hash.end(), 0);
+    std::fill(keep.begin(), keep.end(), 0);
+    std::fill(written.begin(), written.end(), 0);
+    std::fill(clear_pending.begin(), clear_pending.end(), 1);
+    std::fill(dirty.begin(), dirty.end(), 1);
+}
+
+void Framebuffer::resolve() {
+    for (usize tile = 0; tile < clear_pending.size(); tile++) {
+        if (clear_pending[tile]) {
+            fill_color_tile(tile, true);
+        }
+    }
+    _mm_sfence();
+}
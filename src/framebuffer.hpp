@@ -0,0 +1,178 @@
+#pragma once
+
+#include "core.hpp"
+
+#include <immintrin.h>
+
+// edge of the square regions dirty state is tracked in
+#define FRAMEBUFFER_TILE_SIZE 64
+
+// color and depth planes with rows padded to 64 bytes, so every row and
+// both planes start on a cache line. each tile remembers whether it changed
+// since the last upload and whether it holds anything but the clear color,
+// which lets clears and uploads skip the parts of the frame nothing drew to.
+// clears are lazy, they only flag tiles and the fill happens when a tile is
+// first touched, or with streaming stores when it is presented untouched.
+// the color plane can also be memory of a locked texture, which is then
+// drawn into directly and never uploaded
+struct Framebuffer {
+    u32 width = 0;
+    u32 height = 0;
+    u32 pitch = 0; // pixels from one row to the next, in both planes
+    u32 *color = nullptr;
+    f32 *depth = nullptr;
+
+    // static layer restored by clears instead of clear_color, same layout
+    // as color. resize() turns it off
+    u32 *background = nullptr;
+    bool use_background = false;
+    u64 background_key = 0; // whatever the layer was drawn from
+
+    // texture color is locked from, null when color is our own allocation
+    SDL_Texture *texture = nullptr;
+    bool owns_color = true;
+    // texture stores abgr, colors are swizzled on the way in
+    bool swap_red_blue = false;
+
+    u32 tiles_x = 0;
+    u32 tiles_y = 0;
+    std::vector<u8> dirty;         // differs from the uploaded texture
+    std::vector<u8> written;       // differs from clear_color or background
+    std::vector<u8> clear_pending; // clear_color not stored yet
+    u32 clear_color = 0;           // in the plane's format
+
+    // hash of what each tile was drawn from, 0 when unknown. kept tiles
+    // hold their pixels through clears, and neither the rasterizer nor
+    // draw_pixel() touches them this frame
+    std::vector<u64> tile_hash;
+    std::vector<u8> keep;
+
+    std::vector<u8> depth_written; // may hold depths below 1
+    std::vector<u8> depth_pending; // depth clear not stored yet
+
+    Framebuffer() = default;
+    Framebuffer(const Framebuffer &) = delete;
+    Framebuffer &operator=(const Framebuffer &) = delete;
+    ~Framebuffer();
+
+    // exchange everything with other, planes are not copied
+    void swap(Framebuffer &other);
+
+    // reallocate the planes, everything is cleared to clear_color and dirty
+    // and the background layer is dropped. an attached color plane is kept
+    // along with its pitch, it must be large enough for the new size
+    void resize(u32 width, u32 height);
+
+    usize tile_index(u32 x, u32 y) const {
+        return (y / FRAMEBUFFER_TILE_SIZE) * tiles_x +
+               x / FRAMEBUFFER_TILE_SIZE;
+    }
+
+    // draw into pixels with pitch in pixels instead of the owned plane. the
+    // contents are treated as garbage, like those of a freshly locked texture
+    void attach_color(u32 *pixels, u32 pitch);
+    // back to an owned color plane, contents are lost
+    void detach_color();
+
+    // argb color as stored in the plane
+    u32 native(u32 argb) const {
+        if (!swap_red_blue) {
+            return argb;
+        }
+        return (argb & 0xff00ff00) | (argb >> 16 & 0xff) | (argb & 0xff) << 16;
+    }
+
+    // a color write is about to happen at x, y
+    void touch(u32 x, u32 y) {
+        usize tile = tile_index(x, y);
+        if (clear_pending[tile]) {
+            fill_color_tile(tile, false);
+        }
+        dirty[tile] = 1;
+        written[tile] = 1;
+    }
+
+    bool kept(u32 x, u32 y) const { return keep[tile_index(x, y)]; }
+    // every tile under an inclusive pixel rect is kept, false when the
+    // rect is off screen
+    bool all_kept(i32 x0, i32 y0, i32 x1, i32 y1) const;
+
+    // raw access, pending clears are not applied
+    u32 &pixel(u32 x, u32 y) { return color[x + y * pitch]; }
+
+    // depth read or written by a test, applies a pending clear first
+    f32 &depth_at(u32 x, u32 y) {
+        usize tile = tile_index(x, y);
+        if (depth_pending[tile]) {
+            fill_depth_tile(tile);
+        }
+        depth_written[tile] = 1;
+        return depth[x + y * pitch];
+    }
+
+    // apply pending depth clears under an inclusive pixel rect, for passes
+    // that write the depth plane through a raw pointer
+    void prepare_depth(i32 x0, i32 y0, i32 x1, i32 y1);
+
+    // flag written tiles for clearing to argb color, every tile when the
+    // color changed. nothing is stored until the tile is used or presented.
+    // kept tiles are left alone
+    void clear(u32 color);
+    void clear_depth();
+
+    // start restoring from background, call after drawing into it and
+    // before anything else is drawn this frame
+    void set_background();
+
+    // store every pending color clear
+    void resolve();
+
+    void fill_color_tile(usize tile, bool streaming);
+    void fill_depth_tile(usize tile);
+
+    // hand each horizontal run of dirty tiles to upload as one rect, then
+    // forget them
+    template <typename F> void flush_dirty(F upload) {
+        for (u32 ty = 0; ty < tiles_y; ty++) {
+            u32 tx = 0;
+            while (tx < tiles_x) {
+                if (!dirty[ty * tiles_x + tx]) {
+                    tx++;
+                    continue;
+                }
+
+                // tiles cleared and never drawn to since are filled here,
+                // streamed since nothing reads them again this frame
+                u32 run_start = tx;
+                while (tx < tiles_x && dirty[ty * tiles_x + tx]) {
+                    usize tile = ty * tiles_x + tx;
+                    if (clear_pending[tile]) {
+                        fill_color_tile(tile, true);
+                    }
+                    dirty[tile] = 0;
+                    tx++;
+                }
+
+                u32 x0 = run_start * FRAMEBUFFER_TILE_SIZE;
+                u32 y0 = ty * FRAMEBUFFER_TILE_SIZE;
+                u32 x1 = std::min(tx * FRAMEBUFFER_TILE_SIZE, width);
+                u32 y1 = std::min(y0 + FRAMEBUFFER_TILE_SIZE, height);
+                upload(x0, y0, x1 - x0, y1 - y0);
+            }
+        }
+
+        // order the streamed clears before anyone else reads the plane
+        _mm_sfence();
+    }
+
+    struct TileRect {
+        u32 x0, y0, x1, y1; // exclusive end
+    };
+
+    TileRect tile_rect(usize tile) const {
+        u32 x0 = (tile % tiles_x) * FRAMEBUFFER_TILE_SIZE;
+        u32 y0 = (tile / tiles_x) * FRAMEBUFFER_TILE_SIZE;
+        return {x0, y0, std::min(x0 + FRAMEBUFFER_TILE_SIZE, width),
+                std::min(y0 + FRAMEBUFFER_TILE_SIZE, height)};
+    }
+};
@@ -0,0 +1,146 @@
+#include "image.hpp"
+
+static void put_rgb(u8 *out, u32 pixel) {
+    out[0] = pixel >> 16;
+    out[1] = pixel >> 8;
+    out[2] = pixel;
+}
+
+void encode_ppm(ImageView image, std::vector<u8> &out) {
+    char header[32];
+    i32 header_size =
+        snprintf(header, sizeof(header), "P6\n%u %u\n255\n", image.width,
+                 image.height);
+
+    usize pixel_count = static_cast<usize>(image.width) * image.height;
+    out.resize(header_size + pixel_count * 3);
+    std::copy(header, header + header_size, out.begin());
+
+    u8 *rgb = out.data() + header_size;
+    for (u32 y = 0; y < image.height; y++) {
+        const u32 *row = image.pixels + static_cast<usize>(y) * image.pitch;
+        for (u32 x = 0; x < image.width; x++, rgb += 3) {
+            put_rgb(rgb, row[x]);
+        }
+    }
+}
+
+static u32 crc32(const u8 *data, usize size, u32 crc) {
+    static const std::array<u32, 256> table = [] {
+        std::array<u32, 256> t;
+        for (u32 n = 0; n < 256; n++) {
+            u32 c = n;
+            for (u32 k = 0; k < 8; k++) {
+                c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+            }
+            t[n] = c;
+        }
+        return t;
+    }();
+
+    crc = ~crc;
+    for (usize i = 0; i < size; i++) {
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static void put_u32_be(std::vector<u8> &out, u32 v) {
+    out.push_back(v >> 24);
+    out.push_back(v >> 16);
+    out.push_back(v >> 8);
+    out.push_back(v);
+}
+
+static void put_chunk(std::vector<u8> &out, const char type[4],
+                      std::span<const u8> data) {
+    put_u32_be(out, data.size());
+    usize start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    put_u32_be(out, crc32(out.data() + start, out.size() - start, 0));
+}
+
+void encode_png(ImageView image, std::vector<u8> &out) {
+    // filter byte 0 then rgb for every row
+    usize row_size = 1 + static_cast<usize>(image.width) * 3;
+    std::vector<u8> raw(row_size * image.height);
+    for (u32 y = 0; y < image.height; y++) {
+        u8 *rgb = &raw[y * row_size];
+        *rgb++ = 0;
+        const u32 *row = image.pixels + static_cast<usize>(y) * image.pitch;
+        for (u32 x = 0; x < image.width; x++, rgb += 3) {
+            put_rgb(rgb, row[x]);
+        }
+    }
+
+    // zlib stream of stored blocks, at most 65535 bytes each
+    const usize block_size = 65535;
+    std::vector<u8> zlib = {0x78, 0x01};
+    zlib.reserve(raw.size() + raw.size() / block_size * 5 + 16);
+    usize offset = 0;
+    do {
+        usize size = std::min(block_size, raw.size() - offset);
+        bool last = offset + size == raw.size();
+        zlib.push_back(last);
+        zlib.push_back(size);
+        zlib.push_back(size >> 8);
+        zlib.push_back(~size);
+        zlib.push_back(~size >> 8);
+        zlib.insert(zlib.end(), raw.begin() + offset,
+                    raw.begin() + offset + size);
+        offset += size;
+    } while (offset < raw.size());
+
+    u32 a = 1;
+    u32 b = 0;
+    for (u8 byte : raw) {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    put_u32_be(zlib, b << 16 | a);
+
+    // 8 bit rgb, no interlacing
+    std::vector<u8> header;
+    put_u32_be(header, image.width);
+    put_u32_be(header, image.height);
+    header.insert(header.end(), {8, 2, 0, 0, 0});
+
+    const u8 signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    out.assign(signature, signature + sizeof(signature));
+    put_chunk(out, "IHDR", header);
+    put_chunk(out, "IDAT", zlib);
+    put_chunk(out, "IEND", {});
+}
+
+void encode_image(ImageView image, ImageFormat format, std::vector<u8> &out) {
+    switch (format) {
+    case IMAGE_PPM:
+        encode_ppm(image, out);
+        break;
+    case IMAGE_PNG:
+        encode_png(image, out);
+        break;
+    }
+}
+
+bool write_file(const char *path, std::span<const u8> data) {
+    std::ofstream file{path, std::ios::binary};
+    if (!file.is_open()) {
+        fprintf(stderr, "Error: failed to open %s\n", path);
+        return false;
+    }
+
+    file.write(reinterpret_cast<const char *>(data.data()), data.size());
+    return file.good();
+}
+
+const char *image_extension(ImageFormat format) {
+    switch (format) {
+    case IMAGE_PPM:
+        return "ppm";
+    case IMAGE_PNG:
+        return "png";
+    }
+    return "";
+}
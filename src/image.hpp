@@ -0,0 +1,27 @@
+#pragma once
+
+#include "core.hpp"
+
+enum ImageFormat {
+    IMAGE_PPM,
+    IMAGE_PNG,
+};
+
+// argb pixels, pitch in pixels. rgb is written, alpha is dropped
+struct ImageView {
+    const u32 *pixels;
+    u32 width;
+    u32 height;
+    u32 pitch;
+};
+
+// encode into out, replacing its contents
+void encode_ppm(ImageView image, std::vector<u8> &out);
+// uncompressed deflate, large but needs no zlib and takes no time
+void encode_png(ImageView image, std::vector<u8> &out);
+void encode_image(ImageView image, ImageFormat format, std::vector<u8> &out);
+
+bool write_file(const char *path, std::span<const u8> data);
+
+// extension for format, without the dot
+const char *image_extension(ImageFormat format);
@@ -0,0 +1,137 @@
+#include "incremental.hpp"
+#include "display.hpp"
+#include "draw.hpp"
+#include "interlace.hpp"
+
+bool use_incremental = true;
+IncrementalStats incremental_stats;
+
+// tile hashes of the frame being drawn and of the last one submitted
+static std::vector<u64> frame_hashes;
+static std::vector<u64> submitted_hashes;
+// input keys of the same two frames, 0 is unknown
+static u64 frame_key = 0;
+static u64 submitted_key = 0;
+
+u64 hash_bytes(u64 h, const void *data, usize size) {
+    const u8 *bytes = static_cast<const u8 *>(data);
+    for (usize i = 0; i < size; i++) {
+        h = (h ^ bytes[i]) * 0x100000001b3;
+    }
+    return h;
+}
+
+bool inputs_unchanged(u64 key) {
+    frame_key = 0;
+    if (!use_incremental || interlace_mode != INTERLACE_OFF) {
+        return false;
+    }
+
+    key += key == 0;
+    if (key != submitted_key) {
+        frame_key = key;
+        return false;
+    }
+
+    incremental_stats.frames++;
+    incremental_stats.skipped_frames++;
+    return true;
+}
+
+static u64 hash_triangle(const triangle &t) {
+    u64 h = 0xcbf29ce484222325;
+    h = hash_value(h, t.points);
+    h = hash_value(h, t.uv);
+    h = hash_value(h, t.color);
+    h = hash_value(h, t.base_color);
+    h = hash_value(h, t.colors);
+    h = hash_value(h, t.world);
+    h = hash_value(h, t.normals);
+    h = hash_value(h, t.lightmap);
+    h = hash_value(h, t.lightmap_uv);
+    return h;
+}
+
+bool bin_frame(u64 state) {
+    Framebuffer &buffer = frame_buffer;
+    usize tile_count = buffer.tile_hash.size();
+    incremental_stats.frames++;
+
+    // interlaced tiles depend on the previous frame as well
+    if (!use_incremental || interlace_mode != INTERLACE_OFF) {
+        frame_hashes.assign(tile_count, 0);
+        submitted_hashes.clear();
+        std::fill(buffer.keep.begin(), buffer.keep.end(), 0);
+        return true;
+    }
+
+    frame_hashes.assign(tile_count, state);
+    for (DepthKey key : render_order) {
+        const triangle &t = triangles_to_render[key.index];
+        u64 h = hash_triangle(t);
+
+        // the red dots reach 2 pixels past the corners
+        const Vec4 *p = t.points;
+        f32 x0 = std::min({p[0].x, p[1].x, p[2].x}) - 2;
+        f32 y0 = std::min({p[0].y, p[1].y, p[2].y}) - 2;
+        f32 x1 = std::max({p[0].x, p[1].x, p[2].x}) + 2;
+        f32 y1 = std::max({p[0].y, p[1].y, p[2].y}) + 2;
+        if (x1 < 0 || y1 < 0 || x0 >= buffer.width || y0 >= buffer.height) {
+            continue;
+        }
+
+        u32 tx0 = std::max(x0, 0.0f) / FRAMEBUFFER_TILE_SIZE;
+        u32 ty0 = std::max(y0, 0.0f) / FRAMEBUFFER_TILE_SIZE;
+        u32 tx1 = std::min<u32>(x1 / FRAMEBUFFER_TILE_SIZE, buffer.tiles_x - 1);
+        u32 ty1 = std::min<u32>(y1 / FRAMEBUFFER_TILE_SIZE, buffer.tiles_y - 1);
+        for (u32 ty = ty0; ty <= ty1; ty++) {
+            for (u32 tx = tx0; tx <= tx1; tx++) {
+                u64 &tile_hash = frame_hashes[ty * buffer.tiles_x + tx];
+                tile_hash = (tile_hash ^ h) * 0x100000001b3;
+            }
+        }
+    }
+
+    // 0 marks a tile whose contents are unknown
+    for (u64 &h : frame_hashes) {
+        h += h == 0;
+    }
+
+    if (frame_hashes == submitted_hashes) {
+        submitted_key = frame_key;
+        incremental_stats.skipped_frames++;
+        return false;
+    }
+
+    incremental_stats.tiles += tile_count;
+    for (usize tile = 0; tile < tile_count; tile++) {
+        buffer.keep[tile] = buffer.tile_hash[tile] == frame_hashes[tile];
+        incremental_stats.kept_tiles += buffer.keep[tile];
+    }
+    return true;
+}
+
+void commit_frame() {
+    Framebuffer &buffer = frame_buffer;
+    buffer.tile_hash = frame_hashes;
+    std::fill(buffer.keep.begin(), buffer.keep.end(), 0);
+    submitted_hashes = frame_hashes;
+    submitted_key = frame_key;
+}
+
+void redraw_next_frame() {
+    submitted_hashes.clear();
+    submitted_key = 0;
+}
+
+void print_incremental_stats() {
+    const IncrementalStats &stats = incremental_stats;
+    if (stats.frames == 0) {
+        return;
+    }
+
+    printf("incremental: %llu of %llu frames skipped, %.1f%% of tiles kept\n",
+           static_cast<unsigned long long>(stats.skipped_frames),
+           static_cast<unsigned long long>(stats.frames),
+           stats.tiles ? 100.0 * stats.kept_tiles / stats.tiles : 0.0);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "core.hpp"
+
+// every tile gets a hash of the settings and of the triangles binned to it,
+// in drawing order. a buffer remembers the hash each of its tiles was
+// drawn from, tiles that would be drawn from the same inputs again keep
+// their pixels and nothing is drawn into them
+struct IncrementalStats {
+    u64 frames = 0;
+    u64 skipped_frames = 0;
+    u64 tiles = 0;
+    u64 kept_tiles = 0;
+};
+
+extern bool use_incremental;
+extern IncrementalStats incremental_stats;
+
+// hash bytes into h, fnv-1a
+u64 hash_bytes(u64 h, const void *data, usize size);
+
+template <typename T> u64 hash_value(u64 h, const T &value) {
+    return hash_bytes(h, &value, sizeof(value));
+}
+
+// key sums up everything the next frame is made from, taken before
+// anything is transformed. true when it matches the key of the last frame
+// submitted or found unchanged, then the frame needs neither an update nor
+// binning. always false with use_incremental off or while interlacing
+bool inputs_unchanged(u64 key);
+
+// hash triangles_to_render into tiles and flag the tiles of frame_buffer
+// that can keep their pixels. state covers everything besides the
+// triangles that changes pixels. false when the frame would come out the
+// same as the last one submitted, then nothing needs to be drawn. with
+// use_incremental off every tile is drawn and no hashes are kept
+bool bin_frame(u64 state);
+
+// the frame was drawn, remember what every tile of frame_buffer now holds
+void commit_frame();
+
+// draw and submit the next frame even if it comes out the same
+void redraw_next_frame();
+
+void print_incremental_stats();
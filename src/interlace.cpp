@@ -0,0 +1,113 @@
+#include "interlace.hpp"
+#include "display.hpp"
+
+#include <immintrin.h>
+
+InterlaceMode interlace_mode = INTERLACE_OFF;
+u32 interlace_phase = 0;
+
+// the last reconstructed frame, tiles the frame left untouched are not
+// kept and read as background instead
+struct InterlaceHistory {
+    u32 width = 0;
+    u32 height = 0;
+    std::vector<u32> pixels;
+    std::vector<u8> valid;
+};
+
+static InterlaceHistory history;
+
+static u32 background_at(const Framebuffer &buffer, u32 x, u32 y) {
+    if (buffer.use_background) {
+        return buffer.background[x + y * buffer.pitch];
+    }
+    return buffer.clear_color;
+}
+
+// what the pixel will show, tiles still waiting for their clear hold
+// stale pixels
+static u32 shown_at(const Framebuffer &buffer, u32 x, u32 y) {
+    if (buffer.clear_pending[buffer.tile_index(x, y)]) {
+        return background_at(buffer, x, y);
+    }
+    return buffer.color[x + y * buffer.pitch];
+}
+
+static void reconstruct_tile(Framebuffer &buffer, usize tile, bool valid) {
+    Framebuffer::TileRect rect = buffer.tile_rect(tile);
+
+    for (u32 y = rect.y0; y < rect.y1; y++) {
+        for (u32 x = rect.x0; x < rect.x1; x++) {
+            if (!interlace_skip(x, y)) {
+                continue;
+            }
+
+            // per channel bounds of the shaded neighbours
+            __m128i lo = _mm_set1_epi8(-1);
+            __m128i hi = _mm_setzero_si128();
+            auto neighbour = [&](u32 nx, u32 ny) {
+                __m128i n = _mm_cvtsi32_si128(shown_at(buffer, nx, ny));
+                lo = _mm_min_epu8(lo, n);
+                hi = _mm_max_epu8(hi, n);
+            };
+            if (y > 0) {
+                neighbour(x, y - 1);
+            }
+            if (y + 1 < buffer.height) {
+                neighbour(x, y + 1);
+            }
+            if (interlace_mode == INTERLACE_CHECKERBOARD) {
+                if (x > 0) {
+                    neighbour(x - 1, y);
+                }
+                if (x + 1 < buffer.width) {
+                    neighbour(x + 1, y);
+                }
+            }
+
+            u32 previous = valid ? history.pixels[x + y * history.width]
+                                 : background_at(buffer, x, y);
+            __m128i p = _mm_cvtsi32_si128(previous);
+            p = _mm_min_epu8(_mm_max_epu8(p, lo), hi);
+            buffer.color[x + y * buffer.pitch] = _mm_cvtsi128_si32(p);
+        }
+    }
+
+    for (u32 y = rect.y0; y < rect.y1; y++) {
+        const u32 *row = &buffer.color[rect.x0 + y * buffer.pitch];
+        std::copy(row, row + (rect.x1 - rect.x0),
+                  &history.pixels[rect.x0 + y * history.width]);
+    }
+}
+
+void reconstruct_interlaced() {
+    Framebuffer &buffer = frame_buffer;
+    usize tile_count = buffer.written.size();
+
+    if (history.width != buffer.width || history.height != buffer.height ||
+        history.valid.size() != tile_count) {
+        history.width = buffer.width;
+        history.height = buffer.height;
+        history.pixels.assign(static_cast<usize>(buffer.width) * buffer.height,
+                              0);
+        history.valid.assign(tile_count, 0);
+    }
+
+    if (interlace_mode == INTERLACE_OFF) {
+        // frames drawn meanwhile are not kept, start over when turned on
+        std::fill(history.valid.begin(), history.valid.end(), 0);
+        return;
+    }
+
+    for (usize tile = 0; tile < tile_count; tile++) {
+        if (!buffer.written[tile]) {
+            history.valid[tile] = 0;
+            continue;
+        }
+
+        reconstruct_tile(buffer, tile, history.valid[tile]);
+        history.valid[tile] = 1;
+    }
+
+    interlace_phase ^= 1;
+}
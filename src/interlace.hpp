@@ -0,0 +1,35 @@
+#pragma once
+
+#include "core.hpp"
+
+// shade only half the pixels each frame. the pattern flips every frame and
+// the other half is rebuilt from the previous frame by
+// reconstruct_interlaced()
+enum InterlaceMode {
+    INTERLACE_OFF,
+    INTERLACE_CHECKERBOARD,
+    INTERLACE_ROWS,
+};
+
+extern InterlaceMode interlace_mode;
+extern u32 interlace_phase;
+
+// the pixel is left to reconstruction this frame. every surface pass has
+// to leave it alone, reconstruction overwrites it regardless
+inline bool interlace_skip(i32 x, i32 y) {
+    switch (interlace_mode) {
+    case INTERLACE_OFF:
+        return false;
+    case INTERLACE_CHECKERBOARD:
+        return (x + y + interlace_phase) & 1;
+    case INTERLACE_ROWS:
+        return (y + interlace_phase) & 1;
+    }
+    return false;
+}
+
+// fill the skipped pixels of every written tile of frame_buffer with the
+// previous frame, clamped to the range of the shaded neighbours so moving
+// edges do not smear. call after the interlaced passes and before
+// anything drawn at full rate, then keeps the frame and flips the phase
+void reconstruct_interlaced();
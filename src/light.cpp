@@ -0,0 +1,183 @@
+#include "light.hpp"
+#include "display.hpp"
+#include "draw.hpp"
+
+ShadingMode shading_mode = SHADING_FLAT;
+
+LightGrid light_grid;
+
+struct TileRect {
+    i32 x0, y0, x1, y1; // inclusive tile range
+};
+
+static i32 pixel_to_tile(f32 pixel) {
+    return static_cast<i32>(floor(pixel / LIGHT_TILE_SIZE));
+}
+
+// conservative screen tile range of a light's sphere, false when it is
+// behind the camera
+static bool light_tile_rect(const PointLight &point, TileRect &rect) {
+    const Mat4x4f &m = proj_matrix;
+    f32 near = -m[2][3] / m[2][2];
+
+    Vec3 c = Vec3{point.position} - camera_position;
+    f32 r = point.radius;
+
+    if (c.z + r < near) {
+        return false;
+    }
+
+    rect = {0, 0, static_cast<i32>(light_grid.tiles_x) - 1,
+            static_cast<i32>(light_grid.tiles_y) - 1};
+
+    // sphere crosses the near plane, it may cover anything
+    if (c.z - r <= near) {
+        return true;
+    }
+
+    // largest and smallest x / z over the sphere's bounding box, the near
+    // face of the box maximizes magnitude on the side the extent points to
+    f32 max_x = (c.x + r) / (c.x + r >= 0 ? c.z - r : c.z + r);
+    f32 min_x = (c.x - r) / (c.x - r <= 0 ? c.z - r : c.z + r);
+    f32 max_y = (c.y + r) / (c.y + r >= 0 ? c.z - r : c.z + r);
+    f32 min_y = (c.y - r) / (c.y - r <= 0 ? c.z - r : c.z + r);
+
+    // same mapping as the projection in draw_mesh_instanced(), y is flipped
+    f32 half_w = window_width / 2.0;
+    f32 half_h = window_height / 2.0;
+    f32 left = min_x * m[0][0] * half_w + half_w;
+    f32 right = max_x * m[0][0] * half_w + half_w;
+    f32 top = -max_y * m[1][1] * half_h + half_h;
+    f32 bottom = -min_y * m[1][1] * half_h + half_h;
+
+    rect.x0 = std::max(rect.x0, pixel_to_tile(left));
+    rect.x1 = std::min(rect.x1, pixel_to_tile(right));
+    rect.y0 = std::max(rect.y0, pixel_to_tile(top));
+    rect.y1 = std::min(rect.y1, pixel_to_tile(bottom));
+
+    return rect.x0 <= rect.x1 && rect.y0 <= rect.y1;
+}
+
+void build_light_grid(std::span<const PointLight> lights) {
+    light_grid.lights = lights;
+    light_grid.tiles_x =
+        (window_width + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+    light_grid.tiles_y =
+        (window_height + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+
+    usize tile_count = light_grid.tiles_x * light_grid.tiles_y;
+
+    // begin_frame() left both empty
+    light_grid.offsets.assign(tile_count + 1, 0);
+    light_grid.indices.clear();
+
+    if (lights.empty()) {
+        return;
+    }
+
+    ArenaVector<TileRect> rects(lights.size(), frame_arena);
+    ArenaVector<u8> visible(lights.size(), 0, frame_arena);
+
+    // count lights per tile, then prefix sum into offsets
+    for (usize i = 0; i < lights.size(); i++) {
+        if (!light_tile_rect(lights[i], rects[i])) {
+            continue;
+        }
+        visible[i] = 1;
+
+        for (i32 y = rects[i].y0; y <= rects[i].y1; y++) {
+            for (i32 x = rects[i].x0; x <= rects[i].x1; x++) {
+                light_grid.offsets[y * light_grid.tiles_x + x + 1]++;
+            }
+        }
+    }
+
+    for (usize t = 0; t < tile_count; t++) {
+        light_grid.offsets[t + 1] += light_grid.offsets[t];
+    }
+
+    light_grid.indices.resize(light_grid.offsets[tile_count]);
+
+    ArenaVector<u32> cursor(light_grid.offsets.begin(),
+                            light_grid.offsets.end() - 1, frame_arena);
+    for (usize i = 0; i < lights.size(); i++) {
+        if (!visible[i]) {
+            continue;
+        }
+
+        for (i32 y = rects[i].y0; y <= rects[i].y1; y++) {
+            for (i32 x = rects[i].x0; x <= rects[i].x1; x++) {
+                usize tile = y * light_grid.tiles_x + x;
+                light_grid.indices[cursor[tile]++] = i;
+            }
+        }
+    }
+}
+
+static Vec3 point_light_contribution(const PointLight &point, Vec3 position,
+                                     Vec3 normal) {
+    Vec3 to_light = Vec3{point.position} - position;
+    f32 distance_squared = len_squared(to_light);
+    if (distance_squared >= point.radius * point.radius) {
+        return {0, 0, 0};
+    }
+
+    f32 distance = sqrt(distance_squared);
+    f32 n_dot_l = distance > 0 ? dot(normal, to_light) / distance : 1;
+    if (n_dot_l <= 0) {
+        return {0, 0, 0};
+    }
+
+    // smooth falloff reaching zero at the radius
+    f32 falloff = 1 - distance / point.radius;
+    f32 amount = point.intensity * n_dot_l * falloff * falloff;
+
+    return Vec3{point.color} * amount;
+}
+
+static Vec3 directional_contribution(Vec3 normal) {
+    f32 directional = std::max(-dot(normal, light), 0.0f);
+    return {directional, directional, directional};
+}
+
+Vec3 shade_point(Vec3 position, Vec3 normal, i32 x, i32 y) {
+    Vec3 result = directional_contribution(normal);
+
+    if (light_grid.indices.empty()) {
+        return result;
+    }
+
+    i32 tile_x = std::clamp(x / LIGHT_TILE_SIZE, 0,
+                            static_cast<i32>(light_grid.tiles_x) - 1);
+    i32 tile_y = std::clamp(y / LIGHT_TILE_SIZE, 0,
+                            static_cast<i32>(light_grid.tiles_y) - 1);
+    usize tile = tile_y * light_grid.tiles_x + tile_x;
+
+    for (u32 i = light_grid.offsets[tile]; i < light_grid.offsets[tile + 1];
+         i++) {
+        const PointLight &point = light_grid.lights[light_grid.indices[i]];
+        result = result + point_light_contribution(point, position, normal);
+    }
+
+    return result;
+}
+
+Vec3 shade_point_all(Vec3 position, Vec3 normal,
+                     std::span<const PointLight> lights) {
+    Vec3 result = directional_contribution(normal);
+    for (const PointLight &point : lights) {
+        result = result + point_light_contribution(point, position, normal);
+    }
+    return result;
+}
+
+u32 light_apply_color(u32 color, Vec3 intensity) {
+    u32 new_color = color & 0xff000000;
+    for (usize i = 0; i < 3; i++) {
+        u32 shift = 16 - i * 8;
+        f32 channel = ((color >> shift) & 0xff) * intensity[i];
+        new_color |= static_cast<u32>(std::clamp(channel, 0.0f, 255.0f))
+                     << shift;
+    }
+    return new_color;
+}
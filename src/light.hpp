@@ -0,0 +1,50 @@
+#pragma once
+
+#include "arena.hpp"
+#include "core.hpp"
+#include "vector.hpp"
+
+// screen tile edge in pixels for light culling
+#define LIGHT_TILE_SIZE 16
+
+struct PointLight {
+    Vec3 position; // world space
+    f32 radius;    // no contribution past this distance
+    Vec3 color;    // 0..1 per channel
+    f32 intensity;
+};
+
+enum ShadingMode {
+    SHADING_FLAT,    // one evaluation per face, at its centroid
+    SHADING_GOURAUD, // per vertex, colors interpolated
+    SHADING_PIXEL,   // position and normal interpolated, lit per pixel
+};
+
+extern ShadingMode shading_mode;
+
+// lights touching each screen tile, rebuilt every frame from the lights'
+// projected bounds. offsets has one entry per tile plus one, the lights of
+// tile t are indices[offsets[t]] up to indices[offsets[t + 1]]
+struct LightGrid {
+    std::span<const PointLight> lights;
+    u32 tiles_x = 0;
+    u32 tiles_y = 0;
+    ArenaVector<u32> offsets{frame_arena};
+    ArenaVector<u32> indices{frame_arena};
+};
+
+extern LightGrid light_grid;
+
+// bin lights into screen tiles, call after begin_frame() and before any
+// geometry is shaded. begin_frame() empties the grid
+void build_light_grid(std::span<const PointLight> lights);
+
+// directional light plus every point light of the tile covering pixel x, y
+Vec3 shade_point(Vec3 position, Vec3 normal, i32 x, i32 y);
+
+// same lighting against every light, no grid, for bakes done off screen
+Vec3 shade_point_all(Vec3 position, Vec3 normal,
+                     std::span<const PointLight> lights);
+
+// scale each color channel by intensity, alpha is kept
+u32 light_apply_color(u32 color, Vec3 intensity);
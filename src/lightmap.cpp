@@ -0,0 +1,147 @@
+#include "lightmap.hpp"
+
+#include <thread>
+
+static u32 pack_intensity(Vec3 intensity) {
+    u32 texel = 0xff000000;
+    for (usize i = 0; i < 3; i++) {
+        f32 channel = intensity[i] * (255 / LIGHTMAP_RANGE);
+        u32 shift = 16 - i * 8;
+        texel |= static_cast<u32>(std::clamp(channel, 0.0f, 255.0f)) << shift;
+    }
+    return texel;
+}
+
+// world space corners and normals of every face, shared by the workers
+struct BakeFace {
+    Vec3 positions[3];
+    Vec3 normals[3];
+};
+
+static void bake_faces(Lightmap &lightmap, std::span<const BakeFace> faces,
+                       std::span<const PointLight> lights, usize first,
+                       usize last) {
+    const u32 cells_x = lightmap.width / LIGHTMAP_CELL_SIZE;
+    // corners of the face inside its cell, in texels
+    const f32 lo = 0.5;
+    const f32 hi = LIGHTMAP_CELL_SIZE - 1.5;
+
+    for (usize f = first; f < last; f++) {
+        const BakeFace &face = faces[f];
+        u32 cell_x = (f % cells_x) * LIGHTMAP_CELL_SIZE;
+        u32 cell_y = (f / cells_x) * LIGHTMAP_CELL_SIZE;
+
+        for (u32 y = 0; y < LIGHTMAP_CELL_SIZE; y++) {
+            for (u32 x = 0; x < LIGHTMAP_CELL_SIZE; x++) {
+                // weights of the texel center, clamped onto the face so the
+                // texels around it repeat the edge and nearest fetches
+                // never bleed in the neighbouring cell
+                f32 beta = (x + 0.5f - lo) / (hi - lo);
+                f32 gamma = (y + 0.5f - lo) / (hi - lo);
+                beta = std::clamp(beta, 0.0f, 1.0f);
+                gamma = std::clamp(gamma, 0.0f, 1.0f);
+                if (beta + gamma > 1) {
+                    f32 sum = beta + gamma;
+                    beta /= sum;
+                    gamma /= sum;
+                }
+                f32 alpha = 1 - beta - gamma;
+
+                Vec3 p[3] = {face.positions[0], face.positions[1],
+                             face.positions[2]};
+                Vec3 n[3] = {face.normals[0], face.normals[1],
+                             face.normals[2]};
+                Vec3 position = p[0] * alpha + p[1] * beta + p[2] * gamma;
+                Vec3 normal = n[0] * alpha + n[1] * beta + n[2] * gamma;
+
+                f32 length = len(normal);
+                if (length > 0) {
+                    normal = normal / length;
+                }
+
+                Vec3 intensity = shade_point_all(position, normal, lights);
+                lightmap.texels[(cell_x + x) + (cell_y + y) * lightmap.width] =
+                    pack_intensity(intensity);
+            }
+        }
+    }
+}
+
+Lightmap bake_lightmap(const Mesh &mesh, const Mat4x4f &transform,
+                       std::span<const PointLight> lights, u32 thread_count) {
+    Lightmap lightmap;
+
+    usize index_count = mesh_index_count(mesh);
+    usize face_count = index_count / 3;
+    if (face_count == 0) {
+        return lightmap;
+    }
+
+    // square-ish grid of cells
+    u32 cells_x = ceil(sqrt(static_cast<f32>(face_count)));
+    u32 cells_y = (face_count + cells_x - 1) / cells_x;
+    lightmap.width = cells_x * LIGHTMAP_CELL_SIZE;
+    lightmap.height = cells_y * LIGHTMAP_CELL_SIZE;
+    lightmap.texels.assign(lightmap.width * lightmap.height, 0xff000000);
+
+    const f32 lo = 0.5;
+    const f32 hi = LIGHTMAP_CELL_SIZE - 1.5;
+    lightmap.uv_buffer.resize(index_count);
+    for (usize f = 0; f < face_count; f++) {
+        f32 x = (f % cells_x) * LIGHTMAP_CELL_SIZE;
+        f32 y = (f / cells_x) * LIGHTMAP_CELL_SIZE;
+        Vec2 corners[3] = {
+            {x + lo, y + lo},
+            {x + hi, y + lo},
+            {x + lo, y + hi},
+        };
+        for (usize j = 0; j < 3; j++) {
+            lightmap.uv_buffer[f * 3 + j] = {corners[j].x / lightmap.width,
+                                             corners[j].y / lightmap.height};
+        }
+    }
+
+    const Mat4x4f vertex_matrix = dequantize_matrix(mesh) * transform;
+    const Mat3x3f normals_matrix = normal_matrix(transform);
+    const bool has_vertex_normals =
+        !mesh.normal_buffer.empty() &&
+        mesh.normal_index_buffer.size() == index_count;
+
+    std::vector<BakeFace> faces(face_count);
+    for (usize f = 0; f < face_count; f++) {
+        for (usize j = 0; j < 3; j++) {
+            usize i = f * 3 + j;
+            Vec3 p = mesh_vertex(mesh, mesh_index(mesh, i));
+            faces[f].positions[j] = vertex_matrix * Vec4{p};
+
+            Vec3 n = has_vertex_normals
+                         ? mesh.normal_buffer[mesh.normal_index_buffer[i]]
+                         : mesh.face_normal_buffer[f];
+            faces[f].normals[j] = norm(normals_matrix * n);
+        }
+    }
+
+    if (thread_count == 0) {
+        thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    thread_count = std::min<usize>(thread_count, face_count);
+
+    // faces own disjoint cells, so workers write without locking
+    std::vector<std::thread> workers;
+    usize per_thread = (face_count + thread_count - 1) / thread_count;
+    for (u32 t = 0; t < thread_count; t++) {
+        usize first = t * per_thread;
+        usize last = std::min(face_count, first + per_thread);
+        workers.emplace_back(bake_faces, std::ref(lightmap),
+                             std::span<const BakeFace>(faces), lights, first,
+                             last);
+    }
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+
+    printf("lightmap: %ux%u texels, %zu faces, %u threads\n", lightmap.width,
+           lightmap.height, face_count, thread_count);
+
+    return lightmap;
+}
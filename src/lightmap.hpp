@@ -0,0 +1,39 @@
+#pragma once
+
+#include "core.hpp"
+#include "light.hpp"
+#include "matrix.hpp"
+#include "mesh.hpp"
+#include "vector.hpp"
+
+// texels along the edge of the square atlas cell each face gets
+#define LIGHTMAP_CELL_SIZE 8
+// light intensity stored as 255 in a texel channel
+#define LIGHTMAP_RANGE 2.0f
+
+// lighting of a static mesh baked into a second texture. every face owns a
+// cell of the atlas and maps onto its lower left half
+struct Lightmap {
+    u32 width = 0;
+    u32 height = 0;
+    std::vector<u32> texels;     // packed rgb intensity
+    std::vector<Vec2> uv_buffer; // three lightmap uvs per face
+};
+
+// evaluate the directional light and every point light over the mesh placed
+// at transform, split across thread_count threads (0 picks one per core)
+Lightmap bake_lightmap(const Mesh &mesh, const Mat4x4f &transform,
+                       std::span<const PointLight> lights,
+                       u32 thread_count = 0);
+
+inline Vec3 sample_lightmap(const Lightmap &lightmap, Vec2 uv) {
+    i32 x = std::clamp(static_cast<i32>(uv.x * lightmap.width), 0,
+                       static_cast<i32>(lightmap.width) - 1);
+    i32 y = std::clamp(static_cast<i32>(uv.y * lightmap.height), 0,
+                       static_cast<i32>(lightmap.height) - 1);
+    u32 texel = lightmap.texels[x + y * lightmap.width];
+
+    const f32 scale = LIGHTMAP_RANGE / 255;
+    return {((texel >> 16) & 0xff) * scale, ((texel >> 8) & 0xff) * scale,
+            (texel & 0xff) * scale};
+}
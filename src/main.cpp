@@ -1,24 +1,67 @@
+#include "capture.hpp"
 #include "core.hpp"
 #include "display.hpp"
+#include "draw.hpp"
+#include "incremental.hpp"
+#include "interlace.hpp"
+#include "light.hpp"
+#include "lightmap.hpp"
 #include "matrix.hpp"
 #include "mesh.hpp"
+#include "mesh_optimize.hpp"
+#include "offscreen.hpp"
+#include "pacer.hpp"
+#include "present.hpp"
+#include "resolution.hpp"
+#include "scene.hpp"
+#include "shadow.hpp"
+#include "shared_frames.hpp"
+#include "stream.hpp"
 #include "texture.hpp"
 #include "vector.hpp"
 
+#include <atomic>
+#include <mutex>
+
 u64 counter_frequency;
 u64 frame_start;
 u64 frame_end;
 f64 frame_time;
 
-bool is_running = false;
+std::atomic<bool> is_running = false;
+
+// stop after this many presented frames, 0 runs until quit. frames left
+// out because nothing changed count as presented
+u64 frame_limit = 0;
+std::atomic<u64> unchanged_frames = 0;
+
+// --stream destination, empty for none
+std::string stream_destination;
+StreamFormat stream_format = STREAM_Y4M;
+// --shm object name, empty for none
+std::string shared_frames_name;
+
+// F12 writes the next drawn frame to screenshot_<n>.png
+bool screenshot_requested = false;
+u32 screenshot_count = 0;
+
+// events polled on the main thread, handled on the render thread
+std::mutex event_mutex;
+std::vector<SDL_Event> pending_events;
+// the render thread's side of the swap, kept so neither buffer is freed
+std::vector<SDL_Event> handled_events;
 
 Mesh mesh;
 const u32 *mesh_texture;
+u32 mesh_node;
+Quat mesh_spin;
+bool animate = true;
 
-std::vector<triangle> triangles_to_render;
-
-Vec3 camera_position = {0, 0, 0};
-Mat4x4f proj_matrix;
+// static floor, lit once by bake_lightmap()
+Mesh floor_mesh;
+u32 floor_node;
+Lightmap floor_lightmap;
+u32 floor_color = 0xffaaaaaa;
 
 enum RenderMode {
     FILL = 0b1,
@@ -38,19 +81,27 @@ u32 wireframe_color = 0xff000000;
 u32 dot_color = 0xffff0000;
 
 bool use_color = true;
-bool cull_mode = true;
+bool quantize_meshes = true;
+// draw straight into locked textures instead of uploading a copy
+bool zero_copy = true;
+
+std::vector<PointLight> point_lights;
+bool use_point_lights = true;
 
-Vec3 light = {0.0, 0.0, 1.0};
+// depth only pass before the textured pass, each texel is then sampled at
+// most once per pixel
+bool use_depth_prepass = true;
+
+std::vector<ShadowCaster> shadow_casters;
+bool use_shadows = true;
 
 void setup() {
     counter_frequency = SDL_GetPerformanceFrequency() / 1000;
 
-    frame_buffer = std::vector<u32>();
-    frame_buffer.resize(sizeof(u32) * window_width * window_height);
+    frame_buffer.clear_color = 0xff222222;
+    frame_buffer.resize(window_width, window_height);
+    present_init(zero_copy);
 
-    frame_buffer_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
-                                             SDL_TEXTUREACCESS_STREAMING,
-                                             window_width, window_height);
     f32 fov = std::numbers::pi / 3.0;
     f32 aspect = window_height / static_cast<float>(window_width);
     f32 near = 0.1;
@@ -58,13 +109,54 @@ void setup() {
     proj_matrix = Mat4x4f::perspective(fov, aspect, near, far);
 
     mesh = load_obj("assets/f22.obj");
+    optimize_vertex_cache(mesh);
+    optimize_vertex_fetch(mesh);
+    if (quantize_meshes) {
+        quantize_mesh(mesh);
+    }
+
+    mesh_node = add_transform_node();
+    set_translate(mesh_node, {0, 0, 5});
+    mesh_spin = Quat::euler(0.01, 0.01, 0.01);
     mesh_texture = reinterpret_cast<const u32 *>(REDBRICK_TEXTURE);
+
+    floor_mesh = load_cube_mesh_data();
+    floor_node = add_transform_node();
+    set_translate(floor_node, {0, -1.5, 5});
+    set_scale(floor_node, {3, 0.1, 3});
+
+    shadow_casters.push_back({&mesh, mesh_node});
+    shadow_map.center = {0, -0.5, 5};
+    shadow_map.radius = 3.5;
+
+    // ring of colored lights around the mesh
+    const u32 light_count = 256;
+    for (u32 i = 0; i < light_count; i++) {
+        f32 angle = i * (2 * std::numbers::pi / light_count);
+        f32 height = (i % 8) * 0.5 - 1.75;
+        point_lights.push_back({
+            .position = {3 * cos(angle), height, 5 + 3 * sin(angle)},
+            .radius = 2.5,
+            .color = {0.5f + 0.5f * cos(angle), 0.5f + 0.5f * sin(angle),
+                      0.5f - 0.5f * cos(angle)},
+            .intensity = 0.6,
+        });
+    }
+
+    update_transforms();
+    floor_lightmap = bake_lightmap(floor_mesh, world_matrices[floor_node],
+                                   point_lights);
 }
 
-void input() {
+void poll_events() {
     SDL_Event event;
-    SDL_PollEvent(&event);
+    while (SDL_PollEvent(&event)) {
+        std::lock_guard lock(event_mutex);
+        pending_events.push_back(event);
+    }
+}
 
+void handle_event(const SDL_Event &event) {
     switch (event.type) {
     case SDL_EVENT_QUIT:
         is_running = false;
@@ -108,209 +200,472 @@ void input() {
         case SDLK_F:
             use_color = false;
             break;
+        case SDLK_P:
+            use_point_lights = !use_point_lights;
+            break;
+        case SDLK_Z:
+            use_depth_prepass = !use_depth_prepass;
+            break;
+        case SDLK_S:
+            use_shadows = !use_shadows;
+            break;
+        case SDLK_L:
+            // swing the light around y, forces a full shadow map render
+            light = Vec3{Mat4x4f::rotation_y(0.1) * Vec4{light}};
+            break;
+        case SDLK_G:
+            shading_mode = static_cast<ShadingMode>((shading_mode + 1) % 3);
+            break;
+        case SDLK_SPACE:
+            animate = !animate;
+            break;
+        case SDLK_F12:
+            screenshot_requested = true;
+            redraw_next_frame();
+            break;
+        case SDLK_N:
+            use_incremental = !use_incremental;
+            break;
+        case SDLK_I:
+            interlace_mode =
+                static_cast<InterlaceMode>((interlace_mode + 1) % 3);
+            break;
+        case SDLK_R:
+            resolution_scaler.enabled = !resolution_scaler.enabled;
+            if (!resolution_scaler.enabled) {
+                reset_render_scale();
+            }
+            break;
         }
     }
 }
 
-u32 light_apply_intensity(u32 color, f32 factor) {
-    if (factor < 0) {
-        factor = 0;
+void input() {
+    {
+        std::lock_guard lock(event_mutex);
+        handled_events.swap(pending_events);
+    }
+
+    for (const SDL_Event &event : handled_events) {
+        handle_event(event);
+    }
+    handled_events.clear();
+}
+
+void update() {
+    if (animate) {
+        set_rotation(mesh_node,
+                     norm(mesh_spin * transform_nodes[mesh_node].rotation));
     }
-    if (factor > 1) {
-        factor = 1;
+
+    update_transforms();
+
+    if (use_shadows) {
+        update_shadow_map(shadow_casters);
     }
 
-    u32 a = (color & 0xff000000);
-    u32 r = (color & 0x00ff0000) * factor;
-    u32 g = (color & 0x0000ff00) * factor;
-    u32 b = (color & 0x000000ff) * factor;
+    if (use_point_lights) {
+        build_light_grid(point_lights);
+    } else {
+        build_light_grid({});
+    }
 
-    u32 new_color = a | (r & 0x00ff0000) | (g & 0x0000ff00) | (b & 0x000000ff);
+    draw_mesh(mesh, world_matrices[mesh_node], fill_color);
+    draw_mesh_lightmapped(floor_mesh, world_matrices[floor_node], floor_color,
+                          floor_lightmap);
 
-    return new_color;
+    // sort back to front
+    sort_triangles();
 }
 
-void update() {
-    mesh.translate.z = 5;
-    mesh.rotation.x += 0.01;
-    mesh.rotation.y += 0.01;
-    mesh.rotation.z += 0.01;
-
-    const Mat4x4f world_matrix =
-        Mat4x4f::identity() *
-        Mat4x4f::scale(mesh.scale.x, mesh.scale.y, mesh.scale.z) *
-        Mat4x4f::rotation_x(mesh.rotation.x) *
-        Mat4x4f::rotation_y(mesh.rotation.y) *
-        Mat4x4f::rotation_z(mesh.rotation.z) *
-        Mat4x4f::translate(mesh.translate.x, mesh.translate.y,
-                           mesh.translate.z);
-
-    size_t vertices = mesh.index_buffer.size();
-    for (size_t i = 0; i < vertices - 2; i += 3) {
-        Vec2 face_uv[3] = {mesh.uv_buffer[mesh.uv_index_buffer[i]],
-                           mesh.uv_buffer[mesh.uv_index_buffer[i + 1]],
-                           mesh.uv_buffer[mesh.uv_index_buffer[i + 2]]};
-
-        Vec3 face_vertices[3] = {
-            mesh.vertex_buffer[mesh.index_buffer[i]],
-            mesh.vertex_buffer[mesh.index_buffer[i + 1]],
-            mesh.vertex_buffer[mesh.index_buffer[i + 2]],
-        };
-
-        Vec4 transformed_vertices[3];
-        for (int j = 0; j < 3; j++) {
-            Vec4 transformed_vertex = Vec4{face_vertices[j]};
-
-            transformed_vertices[j] = world_matrix * transformed_vertex;
-        }
+// overlays are drawn at full rate on top of everything else
+void draw_dots(const triangle &triangle) {
+    if (render_mode & RenderMode::WIREFRAME_REDDOT) {
+        draw_rect(triangle.points[0].x, triangle.points[0].y, 4, 4, dot_color);
+        draw_rect(triangle.points[1].x, triangle.points[1].y, 4, 4, dot_color);
+        draw_rect(triangle.points[2].x, triangle.points[2].y, 4, 4, dot_color);
+    }
+}
 
-        Vec3 a = transformed_vertices[0];
-        Vec3 b = transformed_vertices[1];
-        Vec3 c = transformed_vertices[2];
+void draw_surface(const triangle &triangle, bool textured) {
+    if (render_mode & (RenderMode::FILL_WIREFRAME | RenderMode::FILL) &&
+        triangle.lightmap) {
+        draw_lightmapped_triangle(triangle, nullptr);
+    } else if (render_mode & (RenderMode::FILL_WIREFRAME | RenderMode::FILL)) {
+        switch (shading_mode) {
+        case SHADING_FLAT:
+            draw_filled_triangle(triangle.points[0].x, triangle.points[0].y,
+                                 triangle.points[1].x, triangle.points[1].y,
+                                 triangle.points[2].x, triangle.points[2].y,
+                                 triangle.color);
+            break;
+        case SHADING_GOURAUD:
+            draw_gouraud_triangle(triangle);
+            break;
+        case SHADING_PIXEL:
+            draw_lit_triangle(triangle);
+            break;
+        }
+    }
 
-        Vec3 ab = b - a;
-        Vec3 ac = c - a;
-        ab = norm(ab);
-        ac = norm(ac);
+    if (textured && use_shadows) {
+        draw_shadowed_triangle(triangle, mesh_texture);
+    } else if (textured && triangle.lightmap) {
+        draw_lightmapped_triangle(triangle, mesh_texture);
+    } else if (textured) {
+        draw_textured_triangle(triangle.points[0].x, triangle.points[0].y,
+                               triangle.points[0].z,
+                               triangle.points[0].w,               //
+                               triangle.uv[0].r, triangle.uv[0].g, //
+                               triangle.points[1].x, triangle.points[1].y,
+                               triangle.points[1].z,
+                               triangle.points[1].w,               //
+                               triangle.uv[1].r, triangle.uv[1].g, //
+                               triangle.points[2].x, triangle.points[2].y,
+                               triangle.points[2].z,
+                               triangle.points[2].w,               //
+                               triangle.uv[2].r, triangle.uv[2].g, //
+                               mesh_texture);
+    }
+}
 
-        Vec3 normal = cross(ab, ac);
-        normal = norm(normal);
+void draw_wireframe(const triangle &triangle) {
+    if (render_mode &
+        (RenderMode::FILL_WIREFRAME | RenderMode::WIREFRAME |
+         RenderMode::WIREFRAME_REDDOT | RenderMode::TEXTURED_WIREFRAME)) {
+        draw_triangle(triangle.points[0].x, triangle.points[0].y,
+                      triangle.points[1].x, triangle.points[1].y,
+                      triangle.points[2].x, triangle.points[2].y,
+                      wireframe_color);
+    }
+}
 
-        // vector between a and camera
-        Vec3 cam_ray = camera_position - a;
+// everything besides the triangles that decides what the pixels become
+u64 render_state() {
+    u64 h = 0xcbf29ce484222325;
+    h = hash_value(h, render_mode);
+    h = hash_value(h, shading_mode);
+    h = hash_value(h, use_shadows);
+    h = hash_value(h, shadow_map.full_renders);
+    h = hash_value(h, shadow_map.partial_renders);
+    h = hash_value(h, use_point_lights);
+    h = hash_value(h, use_depth_prepass);
+    h = hash_value(h, wireframe_color);
+    h = hash_value(h, dot_color);
+    h = hash_value(h, light);
+    h = hash_value(h, mesh_texture);
+    h = hash_value(h, frame_buffer.background_key);
+    h = hash_value(h, frame_buffer.clear_color);
+    h = hash_value(h, window_width);
+    h = hash_value(h, window_height);
+    return h;
+}
 
-        // backface culling
-        if (cull_mode) {
-            float alignment = dot(normal, cam_ray);
-            if (alignment < 0) {
-                continue;
-            }
-        }
+// everything update() and render() read, cheap enough to check before
+// either runs. the transforms count through their versions, a node that
+// was set since the last update is still dirty
+u64 frame_key() {
+    u64 h = render_state();
+    h = hash_value(h, animate);
+    h = hash_value(h, cull_mode);
+    h = hash_value(h, fill_color);
+    h = hash_value(h, floor_color);
+    h = hash_value(h, resolution_scaler.scale);
+    for (const TransformNode &node : transform_nodes) {
+        h = hash_value(h, node.version);
+        h = hash_value(h, node.dirty);
+    }
+    return h;
+}
 
-        f32 avg_depth = (a.z + b.z + c.z) / 3;
+// everything the triangle draws, red dots included, lands in tiles that
+// keep their pixels this frame
+bool triangle_kept(const triangle &triangle) {
+    const Vec4 *p = triangle.points;
+    return frame_buffer.all_kept(std::min({p[0].x, p[1].x, p[2].x}) - 2,
+                                 std::min({p[0].y, p[1].y, p[2].y}) - 2,
+                                 std::max({p[0].x, p[1].x, p[2].x}) + 2,
+                                 std::max({p[0].y, p[1].y, p[2].y}) + 2);
+}
 
-        f32 factor = -dot(normal, light);
-        u32 color = fill_color;
-        color = light_apply_intensity(color, factor);
+// false when the frame came out like the last one and was not drawn
+bool render() {
+    // the grid keeps its spacing on screen at any render size
+    u32 grid_spacing = std::max(1.0f, 40 * resolution_scaler.scale);
+    draw_grid(grid_spacing, grid_spacing);
 
-        Vec4 proj_points[3];
-        for (uint32_t j = 0; j < 3; j++) {
-            proj_points[j] = project(proj_matrix, transformed_vertices[j]);
+    if (!bin_frame(render_state())) {
+        return false;
+    }
 
-            // invert in y
-            proj_points[j].y *= -1;
-            //
-            // scale into view
-            proj_points[j].x *= window_width / 2.0;
-            proj_points[j].y *= window_height / 2.0;
+    // tiles that come out the same keep their pixels through the clear
+    clear_frame_buffer(0xff222222);
+    clear_depth_buffer();
+
+    const bool textured =
+        render_mode & (RenderMode::TEXTURED | RenderMode::TEXTURED_WIREFRAME);
+    depth_func = DEPTH_OFF;
+    if (textured) {
+        depth_func = DEPTH_LESS;
+        if (use_depth_prepass) {
+            for (const triangle &triangle : triangles_to_render) {
+                if (triangle_kept(triangle)) {
+                    continue;
+                }
+                const Vec4 *p = triangle.points;
+                frame_buffer.prepare_depth(
+                    std::min({p[0].x, p[1].x, p[2].x}),
+                    std::min({p[0].y, p[1].y, p[2].y}),
+                    std::max({p[0].x, p[1].x, p[2].x}),
+                    std::max({p[0].y, p[1].y, p[2].y}));
+                draw_depth_triangle(triangle.points[0], triangle.points[1],
+                                    triangle.points[2], frame_buffer.depth,
+                                    frame_buffer.pitch,
+                                    full_rect(window_width, window_height));
+            }
+            depth_func = DEPTH_EQUAL;
+        }
+    }
 
-            // translate to middle of screen
-            proj_points[j].x += window_width / 2.0;
-            proj_points[j].y += window_height / 2.0;
+    // interlaced surfaces are reconstructed before the overlays go on top,
+    // so the overlays are not part of the next frame's history
+    const bool interlaced = interlace_mode != INTERLACE_OFF;
+    for (DepthKey key : render_order) {
+        const triangle &triangle = triangles_to_render[key.index];
+        if (triangle_kept(triangle)) {
+            continue;
         }
+        if (!interlaced) {
+            draw_dots(triangle);
+        }
+        draw_surface(triangle, textured);
+        if (!interlaced) {
+            draw_wireframe(triangle);
+        }
+    }
 
-        triangle projected_triangle = {
-            .points = {proj_points[0], proj_points[1], proj_points[2]},
-            .uv = {face_uv[0], face_uv[1], face_uv[2]},
-            .color = color,
-            .avg_depth = avg_depth,
-        };
+    reconstruct_interlaced();
 
-        triangles_to_render.push_back(projected_triangle);
+    if (interlaced) {
+        for (DepthKey key : render_order) {
+            const triangle &triangle = triangles_to_render[key.index];
+            draw_dots(triangle);
+            draw_wireframe(triangle);
+        }
     }
 
-    // sort front to back
-    std::sort(
-        triangles_to_render.begin(), triangles_to_render.end(),
-        [&](triangle a, triangle b) { return a.avg_depth > b.avg_depth; });
+    commit_frame();
+    return true;
 }
 
-void render() {
-    draw_grid(40, 40);
+// everything but presenting, the renderer stays on the main thread
+void render_loop() {
+    start_pacing();
 
-    u32 num_triangles = triangles_to_render.size();
-    for (size_t i = 0; i < num_triangles; i++) {
-        triangle triangle = triangles_to_render[i];
+    while (is_running) {
+        frame_start = SDL_GetPerformanceCounter();
 
-        if (render_mode & RenderMode::WIREFRAME_REDDOT) {
-            draw_rect(triangle.points[0].x, triangle.points[0].y, 4, 4,
-                      dot_color);
-            draw_rect(triangle.points[1].x, triangle.points[1].y, 4, 4,
-                      dot_color);
-            draw_rect(triangle.points[2].x, triangle.points[2].y, 4, 4,
-                      dot_color);
-        }
+        input();
 
-        if (render_mode & (RenderMode::FILL_WIREFRAME | RenderMode::FILL)) {
-            draw_filled_triangle(triangle.points[0].x, triangle.points[0].y,
-                                 triangle.points[1].x, triangle.points[1].y,
-                                 triangle.points[2].x, triangle.points[2].y,
-                                 triangle.color);
+        // buffers drawn at an older size catch up when they come around
+        if (frame_buffer.width != window_width ||
+            frame_buffer.height != window_height) {
+            frame_buffer.resize(window_width, window_height);
         }
 
-        if (render_mode &
-            (RenderMode::TEXTURED | RenderMode::TEXTURED_WIREFRAME)) {
-            draw_textured_triangle(triangle.points[0].x, triangle.points[0].y,
-                                   triangle.points[0].z,
-                                   triangle.points[0].w,               //
-                                   triangle.uv[0].r, triangle.uv[0].g, //
-                                   triangle.points[1].x, triangle.points[1].y,
-                                   triangle.points[1].z,
-                                   triangle.points[1].w,               //
-                                   triangle.uv[1].r, triangle.uv[1].g, //
-                                   triangle.points[2].x, triangle.points[2].y,
-                                   triangle.points[2].z,
-                                   triangle.points[2].w,               //
-                                   triangle.uv[2].r, triangle.uv[2].g, //
-                                   mesh_texture);
+        begin_frame();
+        // with nothing moved or switched the frame is not even transformed
+        bool changed = false;
+        if (!inputs_unchanged(frame_key())) {
+            update();
+            changed = render();
         }
 
-        if (render_mode &
-            (RenderMode::FILL_WIREFRAME | RenderMode::WIREFRAME |
-             RenderMode::WIREFRAME_REDDOT | RenderMode::TEXTURED_WIREFRAME)) {
-            draw_triangle(triangle.points[0].x, triangle.points[0].y,
-                          triangle.points[1].x, triangle.points[1].y,
-                          triangle.points[2].x, triangle.points[2].y,
-                          wireframe_color);
-        }
-    }
+        frame_end = SDL_GetPerformanceCounter();
+        frame_time = (frame_end - frame_start) / (f64)counter_frequency;
 
-    triangles_to_render.clear();
+        // the main thread uploads and presents it while the next frame is
+        // drawn. an unchanged frame leaves the last one on screen
+        if (!changed) {
+            stream_repeat();
+            unchanged_frames++;
+        } else {
+            if (screenshot_requested) {
+                char path[64];
+                snprintf(path, sizeof(path), "screenshot_%03u.png",
+                         screenshot_count++);
+                // the output size, whatever the render size is right now
+                capture_frame(frame_buffer, output_width, output_height, path,
+                              IMAGE_PNG);
+                screenshot_requested = false;
+            }
+            stream_frame(frame_buffer);
+            publish_frame(frame_buffer, frame_start);
+            if (!submit_frame()) {
+                is_running = false;
+            }
+        }
 
-    render_frame_buffer();
+        update_render_scale(frame_time);
+        wait_for_next_frame();
+    }
+}
 
-    clear_frame_buffer(0xff222222);
+void print_usage(const char *program) {
+    printf("usage: %s [options]\n"
+           "  --offscreen      render without a window\n"
+           "  --size WxH       offscreen frame size\n"
+           "  --frames N       quit after N frames\n"
+           "  --dump PREFIX    write offscreen frames to PREFIX_<frame>.ppm\n"
+           "  --dump-every N   only dump every Nth frame\n"
+           "  --png            dump png instead of ppm\n"
+           "  --fps N          frame rate to pace to, 0 is uncapped\n"
+           "  --uncapped       same as --fps 0\n"
+           "  --dynamic-resolution\n"
+           "                   lower the render size when frames run long\n"
+           "  --interlace checkerboard|rows\n"
+           "                   shade half the pixels each frame\n"
+           "  --full-redraw    draw every tile of every frame\n"
+           "  --no-zero-copy   upload a copy of each frame instead of drawing\n"
+           "                   into locked textures. locked texture memory\n"
+           "                   comes back undefined, so only this way can\n"
+           "                   unchanged tiles keep their pixels on screen\n"
+           "  --still          start with the mesh not spinning\n"
+           "  --stream DEST    also write frames to a file, or to a command\n"
+           "                   after a '|'\n"
+           "  --stream-format y4m|delta\n"
+           "                   yuv 4:2:0 video, or run length coded deltas\n"
+           "  --shm NAME       publish frames in shared memory object NAME\n",
+           program);
+}
 
-    SDL_RenderPresent(renderer);
+bool parse_arguments(i32 argc, char **argv) {
+    for (i32 i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--offscreen") {
+            display_backend = BACKEND_OFFSCREEN;
+        } else if (arg == "--size" && has_value) {
+            u32 width, height;
+            if (sscanf(argv[++i], "%ux%u", &width, &height) != 2 ||
+                width == 0 || height == 0) {
+                fprintf(stderr, "Error: bad size %s\n", argv[i]);
+                return false;
+            }
+            window_width = width;
+            window_height = height;
+        } else if (arg == "--frames" && has_value) {
+            frame_limit = strtoull(argv[++i], NULL, 10);
+        } else if (arg == "--dump" && has_value) {
+            offscreen_target.dump_prefix = argv[++i];
+        } else if (arg == "--dump-every" && has_value) {
+            offscreen_target.dump_interval =
+                std::max(1ul, strtoul(argv[++i], NULL, 10));
+        } else if (arg == "--png") {
+            offscreen_target.dump_format = IMAGE_PNG;
+        } else if (arg == "--fps" && has_value) {
+            frame_pacer.target_rate = std::max(0.0, atof(argv[++i]));
+        } else if (arg == "--uncapped") {
+            frame_pacer.target_rate = 0;
+        } else if (arg == "--dynamic-resolution") {
+            resolution_scaler.enabled = true;
+        } else if (arg == "--interlace" && has_value) {
+            std::string_view pattern = argv[++i];
+            if (pattern == "checkerboard") {
+                interlace_mode = INTERLACE_CHECKERBOARD;
+            } else if (pattern == "rows") {
+                interlace_mode = INTERLACE_ROWS;
+            } else {
+                print_usage(argv[0]);
+                return false;
+            }
+        } else if (arg == "--stream" && has_value) {
+            stream_destination = argv[++i];
+        } else if (arg == "--stream-format" && has_value) {
+            std::string_view format = argv[++i];
+            if (format == "y4m") {
+                stream_format = STREAM_Y4M;
+            } else if (format == "delta") {
+                stream_format = STREAM_DELTA;
+            } else {
+                print_usage(argv[0]);
+                return false;
+            }
+        } else if (arg == "--shm" && has_value) {
+            shared_frames_name = argv[++i];
+        } else if (arg == "--full-redraw") {
+            use_incremental = false;
+        } else if (arg == "--no-zero-copy") {
+            zero_copy = false;
+        } else if (arg == "--still") {
+            animate = false;
+        } else {
+            print_usage(argv[0]);
+            return false;
+        }
+    }
+    return true;
 }
 
-int main() {
+int main(int argc, char **argv) {
+    if (!parse_arguments(argc, argv)) {
+        return 1;
+    }
+
     is_running = initialize_window();
+    if (!is_running) {
+        return 1;
+    }
 
     setup();
 
-    while (is_running) {
-        frame_start = SDL_GetPerformanceCounter();
+    if (!stream_destination.empty()) {
+        u32 rate = frame_pacer.target_rate > 0 ? frame_pacer.target_rate : 60;
+        if (!open_stream(stream_destination.c_str(), stream_format,
+                         output_width, output_height, rate)) {
+            destroy_window();
+            return 1;
+        }
+    }
 
-        input();
-        update();
-        render();
+    if (!shared_frames_name.empty() &&
+        !open_shared_frames(shared_frames_name.c_str(), output_width,
+                            output_height)) {
+        close_stream();
+        destroy_window();
+        return 1;
+    }
 
-        frame_end = SDL_GetPerformanceCounter();
-        frame_time = (frame_end - frame_start) / (f64)counter_frequency;
+    std::thread render_thread(render_loop);
 
-        // sleep for most of the time
-        if (frame_time < TARGET_FRAMETIME) {
-            SDL_Delay((TARGET_FRAMETIME - frame_time) * 0.9);
+    u64 presented = 0;
+    while (is_running) {
+        if (display_backend == BACKEND_SDL) {
+            poll_events();
         }
 
-        // busy wait until target frame time is hit
-        while (frame_time < TARGET_FRAMETIME) {
-            frame_end = SDL_GetPerformanceCounter();
-            frame_time = (frame_end - frame_start) / (f64)counter_frequency;
+        presented += present_frame(TARGET_FRAMETIME);
+        if (frame_limit && presented + unchanged_frames >= frame_limit) {
+            is_running = false;
         }
     }
 
+    present_stop();
+    render_thread.join();
+    close_stream();
+    close_shared_frames();
+    finish_captures();
+
+    print_pacing_stats();
+    print_incremental_stats();
+    print_stream_stats();
+    print_capture_stats();
+    if (resolution_scaler.enabled) {
+        printf("resolution: scale %.3f, %u changes\n",
+               resolution_scaler.scale, resolution_scaler.changes);
+    }
+
     destroy_window();
 
     return 0;
@@ -1,3 +1,5 @@
+#pragma once
+
 #include "core.hpp"
 #include "vector.hpp"
 
@@ -156,6 +158,36 @@ struct Mat4x4f {
         return m;
     }
 
+    // maps the box to x, y in -1..1 and z in 0..1
+    static constexpr Mat4x4f orthographic(f32 left, f32 right, f32 bottom,
+                                          f32 top, f32 near, f32 far) {
+        Mat4x4f m = Mat4x4f::identity();
+        m[0][0] = 2 / (right - left);
+        m[0][3] = -(right + left) / (right - left);
+        m[1][1] = 2 / (top - bottom);
+        m[1][3] = -(top + bottom) / (top - bottom);
+        m[2][2] = 1 / (far - near);
+        m[2][3] = -near / (far - near);
+        return m;
+    }
+
+    // view from eye looking down direction, which becomes +z
+    static Mat4x4f look_along(Vec3f eye, Vec3f direction, Vec3f up) {
+        Vec3f forward = norm(direction);
+        Vec3f right = norm(cross(up, forward));
+        Vec3f new_up = cross(forward, right);
+
+        Mat4x4f m = Mat4x4f::identity();
+        Vec3f axes[3] = {right, new_up, forward};
+        for (usize row = 0; row < 3; row++) {
+            m[row][0] = axes[row].x;
+            m[row][1] = axes[row].y;
+            m[row][2] = axes[row].z;
+            m[row][3] = -dot(axes[row], eye);
+        }
+        return m;
+    }
+
     template <typename... Args> static constexpr Mat4x4f scale(Args... args) {
         f32 scalars[] = {static_cast<f32>(args)...};
         static_assert(std::size(scalars) <= rows());
@@ -186,4 +218,28 @@ struct Mat4x4f {
         }
         return result;
     }
+
+    // inverse transpose of the upper 3x3, scaled so rotation with uniform
+    // scale comes out as the bare rotation and keeps normals unit length
+    friend Mat3x3f normal_matrix(const Mat4x4f &m) {
+        Mat3x3f cofactor;
+        for (usize row = 0; row < 3; row++) {
+            for (usize col = 0; col < 3; col++) {
+                usize r0 = (row + 1) % 3, r1 = (row + 2) % 3;
+                usize c0 = (col + 1) % 3, c1 = (col + 2) % 3;
+                cofactor[row][col] = m[r0][c0] * m[r1][c1] - m[r0][c1] * m[r1][c0];
+            }
+        }
+
+        f32 det = m[0][0] * cofactor[0][0] + m[0][1] * cofactor[0][1] +
+                  m[0][2] * cofactor[0][2];
+        f32 inv_scale = 1 / pow(fabs(det), 2.0f / 3.0f);
+
+        for (usize row = 0; row < 3; row++) {
+            for (usize col = 0; col < 3; col++) {
+                cofactor[row][col] *= inv_scale;
+            }
+        }
+        return cofactor;
+    }
 };
@@ -1,6 +1,9 @@
 #include "mesh.hpp"
 #include "core.hpp"
 
+#include <charconv>
+#include <string.h>
+
 Vec3 v[12] = {
     {-1, -1, -1}, // 1
     {-1, 1, -1},  // 2
@@ -48,297 +51,396 @@ Mesh load_cube_mesh_data() {
         new_mesh.uv_index_buffer.push_back(uv_i[i]);
     }
 
+    compute_bounds(new_mesh);
+    compute_face_normals(new_mesh);
+
     return new_mesh;
 }
 
-struct Token {
-    enum Type {
-        UNINITIALIZED,
-        VERTEX,  // v
-        NORMAL,  // vn
-        UV,      // vt
-        FACE,    // f
-        SURFACE, // s
-        OBJECT,  // o
-        GROUP,   // g
-        USEMTL,  // usemtl
-        MTLLIB,  // mtllib
-        INT,     // 0
-        FLOAT,   // 0.0
-        IDENTIFIER,
-    } tag;
-    typedef enum Type type;
-
-    union {
-        u32 u;
-        i32 i;
-        f32 f;
-    };
+// bytes of the file read at a time, a longer line grows the chunk
+#define OBJ_CHUNK_SIZE (1 << 16)
+
+// what a face line needs besides the mesh it goes into
+struct ObjState {
+    u32 line = 0;
+    // corners without a uv point at a {0, 0} added after the last vt, so it
+    // never shifts the indexes of the file's own
+    bool missing_uvs = false;
+    bool missing_normals = false;
+    bool failed = false;
 };
 
-std::vector<char> buffer;
-std::vector<Token> token_buffer;
-u32 cursor = 0;
-i32 cursor_start = 0;
-i32 cursor_line = 1;
-i32 cursor_prev_line = 0;
-
-std::vector<const char *> id_buffer;
-
-bool is_at_end() { return cursor >= buffer.size(); }
+// one v, v/t, v//n or v/t/n face corner, 0 indexed
+struct ObjCorner {
+    u32 v = 0;
+    u32 t = UINT32_MAX;
+    u32 n = UINT32_MAX;
+};
 
-char advance() { return buffer[cursor++]; }
+static bool is_space(char c) { return c == ' ' || c == '\t' || c == '\r'; }
 
-void add_token_i(Token::Type tag, i32 i) {
-    Token token = {.tag = tag, .i = i};
-    token_buffer.push_back(token);
+static void skip_space(const char *&p, const char *end) {
+    while (p < end && is_space(*p)) {
+        p++;
+    }
 }
 
-void add_token_f(Token::Type tag, f32 f) {
-    Token token = {.tag = tag, .f = f};
-    token_buffer.push_back(token);
+static bool parse_f32(const char *&p, const char *end, f32 &out) {
+    skip_space(p, end);
+    // from_chars takes no sign but '-'
+    if (p < end && *p == '+') {
+        p++;
+    }
+    auto [next, error] = std::from_chars(p, end, out);
+    if (error != std::errc()) {
+        return false;
+    }
+    p = next;
+    return true;
 }
 
-void add_token_u(Token::Type tag, u32 u) {
-    Token token = {.tag = tag, .u = u};
-    token_buffer.push_back(token);
-}
+// .obj is 1 indexed, negative indexes count back from the last element
+static bool parse_index(const char *&p, const char *end, usize count,
+                        u32 &out) {
+    i64 i;
+    auto [next, error] = std::from_chars(p, end, i);
+    if (error != std::errc()) {
+        return false;
+    }
+    p = next;
 
-void add_token(Token::Type tag) { add_token_u(tag, 0); }
+    i64 index = i < 0 ? static_cast<i64>(count) + i : i - 1;
+    if (index < 0 || index >= static_cast<i64>(count)) {
+        return false;
+    }
+    out = index;
+    return true;
+}
 
-/* bool match(char expected) {
-    if (is_at_end()) {
+static bool parse_corner(const char *&p, const char *end, const Mesh &mesh,
+                         ObjCorner &corner) {
+    if (!parse_index(p, end, mesh.vertex_buffer.size(), corner.v)) {
         return false;
     }
-    if (buffer[cursor] != expected) {
+    if (p == end || *p != '/') {
+        return true;
+    }
+
+    p++;
+    if (p < end && *p != '/' &&
+        !parse_index(p, end, mesh.uv_buffer.size(), corner.t)) {
         return false;
     }
+    if (p == end || *p != '/') {
+        return true;
+    }
 
-    cursor++;
-    return true;
-}*/
+    p++;
+    return parse_index(p, end, mesh.normal_buffer.size(), corner.n);
+}
 
-char peek() {
-    if (is_at_end()) {
-        return '\0';
-    }
+static void add_corner(Mesh &mesh, ObjState &state, ObjCorner corner) {
+    mesh.index_buffer.push_back(corner.v);
+
+    state.missing_uvs |= corner.t == UINT32_MAX;
+    mesh.uv_index_buffer.push_back(corner.t);
 
-    return buffer[cursor];
+    // normals are dropped at the end unless every corner had one
+    state.missing_normals |= corner.n == UINT32_MAX;
+    mesh.normal_index_buffer.push_back(corner.n);
 }
 
-char peek_next() {
-    if (cursor + 1 >= buffer.size()) {
-        return '\0';
-    }
+// polygons are split into a fan around their first corner
+static bool parse_face(const char *p, const char *end, Mesh &mesh,
+                       ObjState &state) {
+    ObjCorner first, previous, corner;
+    u32 count = 0;
+    while (true) {
+        skip_space(p, end);
+        if (p == end) {
+            break;
+        }
+        if (!parse_corner(p, end, mesh, corner) ||
+            (p < end && !is_space(*p))) {
+            return false;
+        }
 
-    return buffer[cursor + 1];
+        if (count >= 2) {
+            add_corner(mesh, state, first);
+            add_corner(mesh, state, previous);
+            add_corner(mesh, state, corner);
+        }
+        first = count == 0 ? corner : first;
+        previous = corner;
+        count++;
+    }
+    return count >= 3;
 }
 
-void number() {
-    while (isdigit(peek())) {
-        advance();
+static bool parse_line(const char *p, const char *end, Mesh &mesh,
+                       ObjState &state) {
+    if (const char *comment = static_cast<const char *>(
+            memchr(p, '#', end - p))) {
+        end = comment;
     }
 
-    bool is_float = false;
-    if (peek() == '.' && isdigit(peek_next())) {
-        advance();
-        is_float = true;
+    skip_space(p, end);
+    const char *word = p;
+    while (p < end && !is_space(*p)) {
+        p++;
+    }
+    std::string_view keyword(word, p - word);
 
-        while (isdigit(peek())) {
-            advance();
+    if (keyword == "v") {
+        Vec3 v;
+        if (!parse_f32(p, end, v.x) || !parse_f32(p, end, v.y) ||
+            !parse_f32(p, end, v.z)) {
+            return false;
+        }
+        mesh.vertex_buffer.push_back(v);
+    } else if (keyword == "vt") {
+        // v is optional and defaults to 0
+        Vec2 uv = {0, 0};
+        if (!parse_f32(p, end, uv.x)) {
+            return false;
         }
+        skip_space(p, end);
+        if (p < end && !parse_f32(p, end, uv.y)) {
+            return false;
+        }
+        mesh.uv_buffer.push_back(uv);
+    } else if (keyword == "vn") {
+        Vec3 n;
+        if (!parse_f32(p, end, n.x) || !parse_f32(p, end, n.y) ||
+            !parse_f32(p, end, n.z)) {
+            return false;
+        }
+        mesh.normal_buffer.push_back(n);
+    } else if (keyword == "f") {
+        return parse_face(p, end, mesh, state);
     }
 
-    std::string num(buffer.begin() + cursor_start, buffer.begin() + cursor);
-    if (is_float) {
-        f32 f = std::stof(num);
-        add_token_f(Token::FLOAT, f);
-    } else {
-        i32 i = std::stoi(num);
-        add_token_i(Token::FLOAT, i);
-    }
+    // groups, materials and the like carry nothing we draw
+    return true;
 }
 
-void keyword() {
-    while (isalpha(peek())) {
-        advance();
+// lines are parsed straight out of a fixed size chunk of the file, only
+// the mesh grows with the file
+Mesh load_obj(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "Error: failed to open %s\n", path);
+        return {};
     }
 
-    if (isgraph(peek())) {
-        advance();
+    Mesh new_mesh{};
+    ObjState state;
+    std::vector<char> chunk(OBJ_CHUNK_SIZE);
+    usize carried = 0; // start of a line left over from the last chunk
+
+    bool at_end = false;
+    while (!at_end && !state.failed) {
+        if (carried == chunk.size()) {
+            chunk.resize(chunk.size() * 2);
+        }
+        usize read =
+            fread(chunk.data() + carried, 1, chunk.size() - carried, file);
+        at_end = read == 0;
+
+        const char *p = chunk.data();
+        const char *end = p + carried + read;
+        while (p < end) {
+            const char *newline =
+                static_cast<const char *>(memchr(p, '\n', end - p));
+            if (!newline && !at_end) {
+                break;
+            }
 
-        while (isgraph(peek())) {
-            advance();
+            const char *line_end = newline ? newline : end;
+            state.line++;
+            if (!parse_line(p, line_end, new_mesh, state)) {
+                fprintf(stderr, "Error: %s:%u: malformed line '%.*s'\n", path,
+                        state.line, static_cast<i32>(line_end - p), p);
+                state.failed = true;
+                break;
+            }
+            p = newline ? newline + 1 : end;
         }
+
+        carried = end - p;
+        memmove(chunk.data(), p, carried);
     }
 
-    std::string word(buffer.begin() + cursor_start, buffer.begin() + cursor);
+    bool read_failed = ferror(file);
+    fclose(file);
+    if (read_failed || state.failed) {
+        if (read_failed) {
+            fprintf(stderr, "Error: failed to read %s\n", path);
+        }
+        return {};
+    }
 
-    const char *keyword[] = {"v", "vn", "vt",     "f",     "s",
-                             "o", "g",  "usemtl", "mtllib"};
-    u32 i;
-    for (i = 0; i < std::size(keyword); i++) {
-        const char *kword = keyword[i];
-        if (kword == word) {
-            add_token(static_cast<Token::Type>(i + 1));
-            return;
-        };
+    if (state.missing_uvs) {
+        u32 default_uv = new_mesh.uv_buffer.size();
+        new_mesh.uv_buffer.push_back({0, 0});
+        std::replace(new_mesh.uv_index_buffer.begin(),
+                     new_mesh.uv_index_buffer.end(), UINT32_MAX, default_uv);
+    }
+    if (state.missing_normals) {
+        new_mesh.normal_index_buffer.clear();
     }
 
-    id_buffer.push_back(word.data());
-    add_token_u(Token::IDENTIFIER, id_buffer.size() - 1);
+    compute_bounds(new_mesh);
+    compute_face_normals(new_mesh);
+
+    return new_mesh;
 }
 
-void scan_token() {
-    char c = advance();
-    switch (c) {
-    case '#':
-        while (peek() != '\n' && !is_at_end()) {
-            c = advance();
-        }
-        break;
-    case '\n':
-        cursor_line++;
-        cursor_prev_line = cursor;
-        break;
-    case ' ':
-    case '/':
-    case '\r':
-    case '\t':
-        // ignore these characters
-        break;
-    default:
-        if (c == '-' || isdigit(c)) {
-            number();
-        } else if (isalpha(c)) {
-            keyword();
-        } else {
-            fprintf(stderr, "Error: unexpected character c='%c' at %d,%d\n", c,
-                    cursor_line, cursor - cursor_prev_line);
+void compute_bounds(Mesh &mesh) {
+    if (mesh.vertex_buffer.empty()) {
+        return;
+    }
+
+    Vec3 max = mesh.vertex_buffer[0];
+    mesh.bounds_min = mesh.vertex_buffer[0];
+    for (Vec3 p : mesh.vertex_buffer) {
+        for (usize i = 0; i < Vec3::size(); i++) {
+            mesh.bounds_min[i] = std::min(mesh.bounds_min[i], p[i]);
+            max[i] = std::max(max[i], p[i]);
         }
     }
-    return;
+    mesh.bounds_extent = max - mesh.bounds_min;
+
+    // sphere around the aabb center, loose but cheap
+    mesh.sphere_center = mesh.bounds_min + mesh.bounds_extent * 0.5;
+    mesh.sphere_radius = 0;
+    for (Vec3 p : mesh.vertex_buffer) {
+        mesh.sphere_radius =
+            std::max(mesh.sphere_radius, len(p - mesh.sphere_center));
+    }
 }
 
-Mesh load_obj(const char *path) {
-    std::ifstream file{path, std::ios::ate | std::ios::binary};
-    if (!file.is_open()) {
-        fprintf(stderr, "Error: failed to open %s\n", path);
+void compute_face_normals(Mesh &mesh) {
+    usize face_count = mesh.index_buffer.size() / 3;
+    mesh.face_normal_buffer.resize(face_count);
+
+    for (usize f = 0; f < face_count; f++) {
+        Vec3 a = mesh.vertex_buffer[mesh.index_buffer[f * 3]];
+        Vec3 b = mesh.vertex_buffer[mesh.index_buffer[f * 3 + 1]];
+        Vec3 c = mesh.vertex_buffer[mesh.index_buffer[f * 3 + 2]];
+
+        Vec3 normal = cross(b - a, c - a);
+        f32 length = len(normal);
+
+        // degenerate faces get a zero normal, neither culled nor lit
+        mesh.face_normal_buffer[f] =
+            length > 0 ? normal / length : Vec3{0, 0, 0};
     }
+}
 
-    usize file_size = file.tellg();
+static u16 quantize_unorm16(f32 v, f32 min, f32 extent) {
+    f32 t = (v - min) / extent;
+    t = std::clamp(t, 0.0f, 1.0f);
+    return static_cast<u16>(t * UINT16_MAX + 0.5f);
+}
 
-    // rewind to start of file
-    file.seekg(0);
+// narrow indices to 16 bits when every index fits
+static void quantize_indices(std::vector<u32> &indices,
+                             std::vector<u16> &indices_q, usize count) {
+    if (count > UINT16_MAX + 1) {
+        return;
+    }
 
-    buffer.resize(file_size);
-    file.read(buffer.data(), file_size);
+    indices_q.assign(indices.begin(), indices.end());
+    indices = std::vector<u32>();
+}
 
-    file.close();
+static usize mesh_memory(const Mesh &mesh) {
+    return mesh.vertex_buffer.size() * sizeof(Vec3) +
+           mesh.index_buffer.size() * sizeof(u32) +
+           mesh.uv_buffer.size() * sizeof(Vec2) +
+           mesh.uv_index_buffer.size() * sizeof(u32) +
+           mesh.normal_buffer.size() * sizeof(Vec3) +
+           mesh.normal_index_buffer.size() * sizeof(u32) +
+           mesh.face_normal_buffer.size() * sizeof(Vec3) +
+           mesh.vertex_buffer_q.size() * sizeof(u16) +
+           mesh.index_buffer_q.size() * sizeof(u16) +
+           mesh.uv_buffer_q.size() * sizeof(u16) +
+           mesh.uv_index_buffer_q.size() * sizeof(u16);
+}
 
-    while (!is_at_end()) {
-        cursor_start = cursor;
-        scan_token();
+void quantize_mesh(Mesh &mesh) {
+    if (mesh.quantized || mesh.vertex_buffer.empty()) {
+        return;
     }
 
-    Mesh new_mesh{};
-    for (usize i = 0; i < token_buffer.size(); i++) {
-        switch (token_buffer[i].tag) {
-        case Token::VERTEX:
-            new_mesh.vertex_buffer.push_back({token_buffer[i + 1].f,
-                                              token_buffer[i + 2].f,
-                                              token_buffer[i + 3].f});
-            i += 3;
-            break;
-        case Token::UV:
-            new_mesh.uv_buffer.push_back(
-                {token_buffer[i + 1].f, token_buffer[i + 2].f});
-            i += 2;
-            break;
-        case Token::FACE:
-            // .obj is 1 index, so convert to 0 index
-            new_mesh.index_buffer.push_back(token_buffer[i + 1].i - 1);
-            new_mesh.index_buffer.push_back(token_buffer[i + 4].i - 1);
-            new_mesh.index_buffer.push_back(token_buffer[i + 7].i - 1);
-
-            // .obj is 1 index, so convert to 0 index
-            new_mesh.uv_index_buffer.push_back(token_buffer[i + 2].i - 1);
-            new_mesh.uv_index_buffer.push_back(token_buffer[i + 5].i - 1);
-            new_mesh.uv_index_buffer.push_back(token_buffer[i + 8].i - 1);
-
-            i += 9;
-            break;
-        default:
-            break;
+    usize memory_before = mesh_memory(mesh);
+
+    compute_bounds(mesh);
+
+    Vec2 uv_max = {0, 0};
+    mesh.uv_min = {0, 0};
+    if (!mesh.uv_buffer.empty()) {
+        uv_max = mesh.uv_buffer[0];
+        mesh.uv_min = mesh.uv_buffer[0];
+    }
+    for (Vec2 uv : mesh.uv_buffer) {
+        for (usize i = 0; i < Vec2::size(); i++) {
+            mesh.uv_min[i] = std::min(mesh.uv_min[i], uv[i]);
+            uv_max[i] = std::max(uv_max[i], uv[i]);
         }
     }
+    mesh.uv_extent = uv_max - mesh.uv_min;
 
-    new_mesh.scale = Vec3f{1, 1, 1};
-
-    return new_mesh;
-}
+    // flat axes would divide by zero
+    for (usize i = 0; i < Vec3::size(); i++) {
+        if (mesh.bounds_extent[i] <= 0) {
+            mesh.bounds_extent[i] = 1;
+        }
+    }
+    for (usize i = 0; i < Vec2::size(); i++) {
+        if (mesh.uv_extent[i] <= 0) {
+            mesh.uv_extent[i] = 1;
+        }
+    }
 
-void print_tokens() {
-    i32 num = 0;
-    i32 num_len = 3;
-    Token::Type prev_tag = Token::UNINITIALIZED;
-    for (u32 i = 0; i < token_buffer.size(); i++) {
-        if (num == num_len) {
-            printf("\n");
-            num = 0;
+    mesh.vertex_buffer_q.resize(mesh.vertex_buffer.size() * 3);
+    for (usize v = 0; v < mesh.vertex_buffer.size(); v++) {
+        for (usize i = 0; i < Vec3::size(); i++) {
+            mesh.vertex_buffer_q[v * 3 + i] =
+                quantize_unorm16(mesh.vertex_buffer[v][i], mesh.bounds_min[i],
+                                 mesh.bounds_extent[i]);
         }
-        switch (token_buffer[i].tag) {
-        case Token::UNINITIALIZED:
-            break;
-        case Token::FACE:
-            printf("FACE ");
-            num_len = 9;
-            break;
-        case Token::NORMAL:
-            printf("NORMAL ");
-            num_len = 3;
-            break;
-        case Token::INT:
-            if (prev_tag == Token::SURFACE) {
-                printf("%d\n", token_buffer[i].i);
-            } else {
-                printf("%3d ", token_buffer[i].i);
-                num++;
-            }
-            break;
-        case Token::FLOAT:
-            printf("%f ", token_buffer[i].f);
-            num++;
-            break;
-        case Token::UV:
-            printf("UV ");
-            num_len = 2;
-            break;
-        case Token::VERTEX:
-            printf("VERTEX ");
-            num_len = 3;
-            break;
-        case Token::SURFACE:
-            printf("SURFACE ");
-            break;
-        case Token::OBJECT:
-            printf("OBJECT ");
-            break;
-        case Token::GROUP:
-            printf("GROUP ");
-            break;
-        case Token::USEMTL:
-            printf("USEMTL ");
-            break;
-        case Token::MTLLIB:
-            printf("MTLLIB ");
-            break;
-        case Token::IDENTIFIER:
-            printf("%s\n", id_buffer[token_buffer[i].u]);
-            break;
+    }
+
+    mesh.uv_buffer_q.resize(mesh.uv_buffer.size() * 2);
+    for (usize v = 0; v < mesh.uv_buffer.size(); v++) {
+        for (usize i = 0; i < Vec2::size(); i++) {
+            mesh.uv_buffer_q[v * 2 + i] = quantize_unorm16(
+                mesh.uv_buffer[v][i], mesh.uv_min[i], mesh.uv_extent[i]);
         }
-        prev_tag = token_buffer[i].tag;
     }
-    printf("\n");
-    fflush(stdout);
+
+    quantize_indices(mesh.index_buffer, mesh.index_buffer_q,
+                     mesh.vertex_buffer.size());
+    quantize_indices(mesh.uv_index_buffer, mesh.uv_index_buffer_q,
+                     mesh.uv_buffer.size());
+
+    mesh.vertex_buffer = std::vector<Vec3>();
+    mesh.uv_buffer = std::vector<Vec2>();
+    mesh.quantized = true;
+
+    printf("quantize: %zu -> %zu bytes\n", memory_before, mesh_memory(mesh));
+}
+
+Mat4x4f dequantize_matrix(const Mesh &mesh) {
+    if (!mesh.quantized) {
+        return Mat4x4f::identity();
+    }
+
+    return Mat4x4f::scale(mesh.bounds_extent.x / UINT16_MAX,
+                          mesh.bounds_extent.y / UINT16_MAX,
+                          mesh.bounds_extent.z / UINT16_MAX) *
+           Mat4x4f::translate(mesh.bounds_min.x, mesh.bounds_min.y,
+                              mesh.bounds_min.z);
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "core.hpp"
+#include "matrix.hpp"
 #include "triangle.hpp"
 #include "vector.hpp"
 
@@ -9,14 +10,86 @@ struct Mesh {
     std::vector<u32> index_buffer;    // dynamic array of vertex indexes
     std::vector<Vec2> uv_buffer;      // dynamic array of vertex uv
     std::vector<u32> uv_index_buffer; // dynamic array of vertex color
-    Vec3 rotation = {0, 0, 0};
-    Vec3 scale = {1, 1, 1};
-    Vec3 translate = {0, 0, 0};
+    std::vector<Vec3> normal_buffer;       // vertex normals from vn
+    std::vector<u32> normal_index_buffer;  // dynamic array of normal indexes
+    std::vector<Vec3> face_normal_buffer;  // one unit normal per face
+
+    // quantized storage, filled by quantize_mesh() which frees the f32
+    // buffers above. indices fall back to the u32 buffers when the vertex
+    // or uv count does not fit in 16 bits
+    bool quantized = false;
+    std::vector<u16> vertex_buffer_q;   // unorm16 x, y, z within bounds
+    std::vector<u16> uv_buffer_q;       // unorm16 u, v within uv bounds
+    std::vector<u16> index_buffer_q;    // 16 bit vertex indexes
+    std::vector<u16> uv_index_buffer_q; // 16 bit uv indexes
+    Vec2 uv_min = {0, 0};
+    Vec2 uv_extent = {1, 1};
+
+    // model space bounds, filled by compute_bounds()
+    Vec3 bounds_min = {0, 0, 0};
+    Vec3 bounds_extent = {1, 1, 1};
+    Vec3 sphere_center = {0, 0, 0};
+    f32 sphere_radius = 0;
+
 };
 
 Mesh load_cube_mesh_data();
 
+// triangles of a wavefront .obj, polygons are split into fans. empty when
+// the file cannot be read or has a malformed line
 Mesh load_obj(const char *path);
 
-// debug function
-void print_tokens();
+// aabb and bounding sphere of vertex_buffer
+void compute_bounds(Mesh &mesh);
+
+// model space normal of every face, rotated per frame instead of being
+// rebuilt from the transformed positions
+void compute_face_normals(Mesh &mesh);
+
+// switch mesh to 16 bit storage, run the optimize passes before this
+void quantize_mesh(Mesh &mesh);
+
+// maps positions returned by mesh_vertex() into model space, fold it into
+// the world matrix instead of dequantizing every vertex
+Mat4x4f dequantize_matrix(const Mesh &mesh);
+
+inline usize mesh_index_count(const Mesh &mesh) {
+    return mesh.index_buffer_q.empty() ? mesh.index_buffer.size()
+                                       : mesh.index_buffer_q.size();
+}
+
+inline usize mesh_vertex_count(const Mesh &mesh) {
+    return mesh.quantized ? mesh.vertex_buffer_q.size() / 3
+                          : mesh.vertex_buffer.size();
+}
+
+inline u32 mesh_index(const Mesh &mesh, usize i) {
+    return mesh.index_buffer_q.empty() ? mesh.index_buffer[i]
+                                       : mesh.index_buffer_q[i];
+}
+
+inline u32 mesh_uv_index(const Mesh &mesh, usize i) {
+    return mesh.uv_index_buffer_q.empty() ? mesh.uv_index_buffer[i]
+                                          : mesh.uv_index_buffer_q[i];
+}
+
+// raw position, still quantized when mesh.quantized is set
+inline Vec3 mesh_vertex(const Mesh &mesh, u32 i) {
+    if (!mesh.quantized) {
+        return mesh.vertex_buffer[i];
+    }
+
+    const u16 *q = &mesh.vertex_buffer_q[i * 3];
+    return {static_cast<f32>(q[0]), static_cast<f32>(q[1]),
+            static_cast<f32>(q[2])};
+}
+
+inline Vec2 mesh_uv(const Mesh &mesh, u32 i) {
+    if (!mesh.quantized) {
+        return mesh.uv_buffer[i];
+    }
+
+    const u16 *q = &mesh.uv_buffer_q[i * 2];
+    return {mesh.uv_min.x + q[0] * (mesh.uv_extent.x / UINT16_MAX),
+            mesh.uv_min.y + q[1] * (mesh.uv_extent.y / UINT16_MAX)};
+}
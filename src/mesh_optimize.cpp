@@ -0,0 +1,255 @@
+#include "mesh_optimize.hpp"
+
+// forsyth's linear-speed vertex cache optimisation
+// https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html
+#define FORSYTH_CACHE_SIZE 32
+
+const f32 cache_decay_power = 1.5;
+const f32 last_triangle_score = 0.75;
+const f32 valence_boost_scale = 2.0;
+const f32 valence_boost_power = 0.5;
+
+static f32 vertex_score(i32 cache_position, u32 remaining_triangles) {
+    // no triangles left to emit, never pick this vertex
+    if (remaining_triangles == 0) {
+        return -1;
+    }
+
+    f32 score = 0;
+    if (cache_position >= 0) {
+        if (cache_position < 3) {
+            // used by the last triangle, fixed score so the strip direction
+            // does not matter
+            score = last_triangle_score;
+        } else {
+            f32 scaler = 1.0 / (FORSYTH_CACHE_SIZE - 3);
+            score = 1 - (cache_position - 3) * scaler;
+            score = pow(score, cache_decay_power);
+        }
+    }
+
+    // boost vertices with few triangles left so they get finished off
+    score += valence_boost_scale *
+             pow(static_cast<f32>(remaining_triangles), -valence_boost_power);
+
+    return score;
+}
+
+f32 compute_acmr(std::span<const u32> indices, u32 cache_size) {
+    if (indices.size() < 3) {
+        return 0;
+    }
+
+    u32 vertex_count = *std::max_element(indices.begin(), indices.end()) + 1;
+
+    // a vertex is in the fifo if it was inserted less than cache_size
+    // misses ago
+    std::vector<u32> timestamps(vertex_count, 0);
+    u32 time = cache_size + 1;
+    u32 misses = 0;
+    for (u32 index : indices) {
+        if (time - timestamps[index] > cache_size) {
+            timestamps[index] = time++;
+            misses++;
+        }
+    }
+
+    return misses / static_cast<f32>(indices.size() / 3);
+}
+
+// reorder a buffer holding stride entries per face
+template <typename T>
+static void permute_face_buffer(std::vector<T> &buffer,
+                                std::span<const u32> order, usize stride) {
+    if (buffer.empty()) {
+        return;
+    }
+
+    std::vector<T> new_buffer(buffer.size());
+    for (usize i = 0; i < order.size(); i++) {
+        for (usize j = 0; j < stride; j++) {
+            new_buffer[i * stride + j] = buffer[order[i] * stride + j];
+        }
+    }
+
+    buffer = std::move(new_buffer);
+}
+
+static void permute_faces(Mesh &mesh, std::span<const u32> order) {
+    permute_face_buffer(mesh.index_buffer, order, 3);
+    permute_face_buffer(mesh.uv_index_buffer, order, 3);
+    permute_face_buffer(mesh.normal_index_buffer, order, 3);
+    permute_face_buffer(mesh.face_normal_buffer, order, 1);
+}
+
+void optimize_vertex_cache(Mesh &mesh) {
+    usize triangle_count = mesh.index_buffer.size() / 3;
+    usize vertex_count = mesh.vertex_buffer.size();
+    if (triangle_count == 0) {
+        return;
+    }
+
+    f32 acmr_before = compute_acmr(mesh.index_buffer, ACMR_CACHE_SIZE);
+
+    // triangles using each vertex, packed into one array by vertex
+    std::vector<u32> remaining(vertex_count, 0);
+    for (usize i = 0; i < triangle_count * 3; i++) {
+        remaining[mesh.index_buffer[i]]++;
+    }
+
+    std::vector<u32> offsets(vertex_count + 1, 0);
+    for (usize v = 0; v < vertex_count; v++) {
+        offsets[v + 1] = offsets[v] + remaining[v];
+    }
+
+    std::vector<u32> adjacency(triangle_count * 3);
+    {
+        std::vector<u32> cursor(offsets.begin(), offsets.end() - 1);
+        for (usize i = 0; i < triangle_count * 3; i++) {
+            adjacency[cursor[mesh.index_buffer[i]]++] = i / 3;
+        }
+    }
+
+    std::vector<f32> vertex_scores(vertex_count);
+    for (usize v = 0; v < vertex_count; v++) {
+        vertex_scores[v] = vertex_score(-1, remaining[v]);
+    }
+
+    std::vector<f32> triangle_scores(triangle_count);
+    std::vector<bool> emitted(triangle_count, false);
+    for (usize t = 0; t < triangle_count; t++) {
+        const u32 *tri = &mesh.index_buffer[t * 3];
+        triangle_scores[t] = vertex_scores[tri[0]] + vertex_scores[tri[1]] +
+                             vertex_scores[tri[2]];
+    }
+
+    i32 best = std::max_element(triangle_scores.begin(),
+                                triangle_scores.end()) -
+               triangle_scores.begin();
+
+    std::vector<u32> order;
+    order.reserve(triangle_count);
+
+    std::vector<u32> cache;
+    std::vector<u32> next_cache;
+    cache.reserve(FORSYTH_CACHE_SIZE + 3);
+    next_cache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+    usize input_cursor = 0;
+    while (order.size() < triangle_count) {
+        if (best < 0) {
+            // nothing in the cache has triangles left, restart from the
+            // next triangle in input order
+            while (emitted[input_cursor]) {
+                input_cursor++;
+            }
+            best = input_cursor;
+        }
+
+        emitted[best] = true;
+        order.push_back(best);
+
+        const u32 *tri = &mesh.index_buffer[best * 3];
+
+        // remove triangle from the adjacency of its vertices
+        for (usize j = 0; j < 3; j++) {
+            u32 v = tri[j];
+            u32 *begin = &adjacency[offsets[v]];
+            u32 *end = begin + remaining[v];
+            u32 *it = std::find(begin, end, static_cast<u32>(best));
+            if (it != end) {
+                *it = *(end - 1);
+                remaining[v]--;
+            }
+        }
+
+        // move triangle vertices to the front of the lru cache
+        next_cache.clear();
+        for (usize j = 0; j < 3; j++) {
+            if (std::find(next_cache.begin(), next_cache.end(), tri[j]) ==
+                next_cache.end()) {
+                next_cache.push_back(tri[j]);
+            }
+        }
+        for (u32 v : cache) {
+            if (v != tri[0] && v != tri[1] && v != tri[2]) {
+                next_cache.push_back(v);
+            }
+        }
+
+        // rescore everything that moved in or fell out of the cache
+        for (usize i = 0; i < next_cache.size(); i++) {
+            u32 v = next_cache[i];
+            i32 position =
+                i < FORSYTH_CACHE_SIZE ? static_cast<i32>(i) : -1;
+
+            f32 score = vertex_score(position, remaining[v]);
+            f32 delta = score - vertex_scores[v];
+            vertex_scores[v] = score;
+
+            for (u32 k = 0; k < remaining[v]; k++) {
+                triangle_scores[adjacency[offsets[v] + k]] += delta;
+            }
+        }
+
+        if (next_cache.size() > FORSYTH_CACHE_SIZE) {
+            next_cache.resize(FORSYTH_CACHE_SIZE);
+        }
+        std::swap(cache, next_cache);
+
+        // next triangle is the best one touching the cache
+        best = -1;
+        f32 best_score = -1;
+        for (u32 v : cache) {
+            for (u32 k = 0; k < remaining[v]; k++) {
+                u32 t = adjacency[offsets[v] + k];
+                if (triangle_scores[t] > best_score) {
+                    best_score = triangle_scores[t];
+                    best = t;
+                }
+            }
+        }
+    }
+
+    permute_faces(mesh, order);
+
+    f32 acmr_after = compute_acmr(mesh.index_buffer, ACMR_CACHE_SIZE);
+    printf("vertex cache: acmr %.3f -> %.3f (%zu triangles)\n", acmr_before,
+           acmr_after, triangle_count);
+}
+
+// renumber buffer in first-use order of indices, unreferenced entries are
+// dropped
+template <typename T>
+static void remap_buffer(std::vector<T> &buffer, std::vector<u32> &indices) {
+    std::vector<u32> remap(buffer.size(), UINT32_MAX);
+
+    std::vector<T> new_buffer;
+    new_buffer.reserve(buffer.size());
+
+    for (u32 &index : indices) {
+        if (remap[index] == UINT32_MAX) {
+            remap[index] = new_buffer.size();
+            new_buffer.push_back(buffer[index]);
+        }
+        index = remap[index];
+    }
+
+    buffer = std::move(new_buffer);
+}
+
+void optimize_vertex_fetch(Mesh &mesh) {
+    f32 acmr_before = compute_acmr(mesh.index_buffer, ACMR_CACHE_SIZE);
+    usize vertices_before = mesh.vertex_buffer.size();
+
+    remap_buffer(mesh.vertex_buffer, mesh.index_buffer);
+    remap_buffer(mesh.uv_buffer, mesh.uv_index_buffer);
+    remap_buffer(mesh.normal_buffer, mesh.normal_index_buffer);
+
+    // renumbering does not change the order indices are visited in, so the
+    // acmr should come out identical
+    f32 acmr_after = compute_acmr(mesh.index_buffer, ACMR_CACHE_SIZE);
+    printf("vertex fetch: acmr %.3f -> %.3f (%zu -> %zu vertices)\n",
+           acmr_before, acmr_after, vertices_before,
+           mesh.vertex_buffer.size());
+}
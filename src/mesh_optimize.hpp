@@ -0,0 +1,17 @@
+#pragma once
+
+#include "core.hpp"
+#include "mesh.hpp"
+
+// size of the fifo cache used when reporting acmr
+#define ACMR_CACHE_SIZE 16
+
+// average cache miss ratio, vertices transformed per triangle when the
+// indices are run through a fifo post-transform cache of cache_size entries
+f32 compute_acmr(std::span<const u32> indices, u32 cache_size);
+
+// reorder triangles for post-transform cache locality (forsyth)
+void optimize_vertex_cache(Mesh &mesh);
+
+// renumber vertices and uvs in first-use order of the index buffers
+void optimize_vertex_fetch(Mesh &mesh);
@@ -0,0 +1,75 @@
+#include "offscreen.hpp"
+#include "capture.hpp"
+
+OffscreenTarget offscreen_target;
+
+void initialize_offscreen(u32 width, u32 height) {
+    OffscreenTarget &target = offscreen_target;
+    target.width = width;
+    target.height = height;
+    target.pixels.assign(static_cast<usize>(width) * height, 0);
+    target.frame_count = 0;
+}
+
+// nearest neighbour, whole frame
+static void scale_up(OffscreenTarget &target) {
+    std::vector<u32> columns(target.width);
+    for (u32 x = 0; x < target.width; x++) {
+        columns[x] = static_cast<u64>(x) * target.frame_width / target.width;
+    }
+
+    for (u32 y = 0; y < target.height; y++) {
+        u32 row = static_cast<u64>(y) * target.frame_height / target.height;
+        const u32 *source = &target.frame[row * target.frame_width];
+        u32 *destination = &target.pixels[y * target.width];
+        for (u32 x = 0; x < target.width; x++) {
+            destination[x] = source[columns[x]];
+        }
+    }
+}
+
+void render_offscreen(Framebuffer &buffer) {
+    OffscreenTarget &target = offscreen_target;
+
+    // a smaller frame goes through its own copy, resizing the framebuffer
+    // made every tile dirty so the copy is always complete
+    bool scaled =
+        buffer.width != target.width || buffer.height != target.height;
+    if (scaled && (buffer.width != target.frame_width ||
+                   buffer.height != target.frame_height)) {
+        target.frame_width = buffer.width;
+        target.frame_height = buffer.height;
+        target.frame.assign(static_cast<usize>(buffer.width) * buffer.height,
+                            0);
+    }
+    u32 *pixels = scaled ? target.frame.data() : target.pixels.data();
+
+    // same rects the sdl backend would upload, swizzled back to argb
+    buffer.flush_dirty([&](u32 x, u32 y, u32 width, u32 height) {
+        for (u32 row = y; row < y + height; row++) {
+            const u32 *source = &buffer.pixel(x, row);
+            u32 *destination = &pixels[x + row * buffer.width];
+            for (u32 i = 0; i < width; i++) {
+                destination[i] = buffer.native(source[i]);
+            }
+        }
+    });
+
+    if (scaled) {
+        scale_up(target);
+    }
+
+    target.frame_count++;
+    if (target.dump_prefix.empty() ||
+        target.frame_count % target.dump_interval != 0) {
+        return;
+    }
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s_%06llu.%s", target.dump_prefix.c_str(),
+             static_cast<unsigned long long>(target.frame_count),
+             image_extension(target.dump_format));
+    capture_image({target.pixels.data(), target.width, target.height,
+                   target.width},
+                  path, target.dump_format);
+}
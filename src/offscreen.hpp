@@ -0,0 +1,33 @@
+#pragma once
+
+#include "core.hpp"
+#include "framebuffer.hpp"
+#include "image.hpp"
+
+// where the offscreen backend presents to, argb rows without padding
+struct OffscreenTarget {
+    u32 width = 0;
+    u32 height = 0;
+    std::vector<u32> pixels;
+
+    // frames rendered below the output size land here first and are then
+    // scaled up into pixels
+    u32 frame_width = 0;
+    u32 frame_height = 0;
+    std::vector<u32> frame;
+    u64 frame_count = 0;
+
+    // when set, every dump_interval-th frame is also written to
+    // <dump_prefix>_<frame>.<extension>
+    std::string dump_prefix;
+    u32 dump_interval = 1;
+    ImageFormat dump_format = IMAGE_PPM;
+};
+
+extern OffscreenTarget offscreen_target;
+
+void initialize_offscreen(u32 width, u32 height);
+
+// copy the dirty tiles of buffer into offscreen_target and dump the frame
+// if it is due
+void render_offscreen(Framebuffer &buffer);
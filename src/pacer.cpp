@@ -0,0 +1,84 @@
+#include "pacer.hpp"
+
+FramePacer frame_pacer;
+
+void start_pacing() {
+    FramePacer &pacer = frame_pacer;
+    pacer.started = SDL_GetTicksNS();
+    pacer.deadline = pacer.started;
+    pacer.frames = 0;
+    pacer.missed = 0;
+    pacer.late_total = 0;
+    pacer.late_worst = 0;
+    pacer.slept_total = 0;
+}
+
+void wait_for_next_frame() {
+    FramePacer &pacer = frame_pacer;
+    pacer.frames++;
+
+    u64 now = SDL_GetTicksNS();
+    if (pacer.target_rate <= 0) {
+        pacer.deadline = now;
+        return;
+    }
+
+    u64 period = 1e9 / pacer.target_rate;
+    pacer.deadline += period;
+
+    if (now >= pacer.deadline) {
+        u64 late = now - pacer.deadline;
+        pacer.missed++;
+        pacer.late_total += late;
+        pacer.late_worst = std::max(pacer.late_worst, late);
+
+        // more than a frame behind, start over from here rather than rush
+        // through several frames to catch up
+        if (late >= period) {
+            pacer.deadline = now;
+        }
+        return;
+    }
+
+    // wake early by the expected oversleep, whatever is left is too short
+    // to sleep reliably and the frame just starts that much early
+    u64 slack = std::min<f64>(pacer.slack + 2 * pacer.slack_deviation,
+                              period / 2);
+    if (pacer.deadline - now <= slack) {
+        return;
+    }
+
+    u64 wake = pacer.deadline - slack;
+    SDL_DelayNS(wake - now);
+    u64 woke = SDL_GetTicksNS();
+    pacer.slept_total += woke - now;
+
+    // running mean and mean deviation of the oversleep
+    f64 oversleep = static_cast<f64>(woke) - static_cast<f64>(wake);
+    const f64 rate = 0.1;
+    pacer.slack += (oversleep - pacer.slack) * rate;
+    pacer.slack_deviation +=
+        (fabs(oversleep - pacer.slack) - pacer.slack_deviation) * rate;
+}
+
+void print_pacing_stats() {
+    const FramePacer &pacer = frame_pacer;
+    if (pacer.frames == 0) {
+        return;
+    }
+
+    f64 elapsed = (SDL_GetTicksNS() - pacer.started) / 1e9;
+    f64 missed_percent = 100.0 * pacer.missed / pacer.frames;
+    f64 late_mean =
+        pacer.missed ? pacer.late_total / 1e6 / pacer.missed : 0.0;
+
+    printf("pacing: %llu frames, %.1f fps, target %.1f\n",
+           static_cast<unsigned long long>(pacer.frames),
+           pacer.frames / elapsed, pacer.target_rate);
+    printf("pacing: %llu missed (%.1f%%), %.3f ms late on average, "
+           "%.3f ms worst\n",
+           static_cast<unsigned long long>(pacer.missed), missed_percent,
+           late_mean, pacer.late_worst / 1e6);
+    printf("pacing: slept %.1f%% of the time, slack %.3f ms\n",
+           100.0 * pacer.slept_total / 1e9 / elapsed, pacer.slack / 1e6);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "core.hpp"
+
+// keeps frames on a fixed schedule by sleeping. the oversleep of past
+// sleeps is tracked, and each sleep ends that much before the deadline
+// instead of spinning through the rest
+struct FramePacer {
+    f64 target_rate = 60; // frames per second, 0 runs uncapped
+
+    u64 deadline = 0;  // start of the next frame, ns
+    f64 slack = 2e5;   // expected oversleep, ns
+    f64 slack_deviation = 0;
+
+    // stats since start_pacing()
+    u64 started = 0;
+    u64 frames = 0;
+    u64 missed = 0;
+    u64 late_total = 0; // ns past the deadline over all missed frames
+    u64 late_worst = 0;
+    u64 slept_total = 0;
+};
+
+extern FramePacer frame_pacer;
+
+void start_pacing();
+
+// call when a frame is done, returns at the start of the next one
+void wait_for_next_frame();
+
+void print_pacing_stats();
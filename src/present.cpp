@@ -0,0 +1,165 @@
+#include "present.hpp"
+#include "display.hpp"
+#include "offscreen.hpp"
+
+#include <condition_variable>
+#include <mutex>
+
+enum SlotState {
+    SLOT_FREE,
+    SLOT_QUEUED,
+    SLOT_PRESENTING,
+};
+
+static Framebuffer spares[PRESENT_SPARE_COUNT];
+static SlotState slot_states[PRESENT_SPARE_COUNT];
+static std::deque<usize> queued_slots;
+static bool stopped = false;
+
+static std::mutex present_mutex;
+static std::condition_variable present_condition;
+
+// tiles of the frame on screen that hold more than the background, and
+// what they were drawn from. only touched by the renderer thread
+static std::vector<u8> presented_written;
+static std::vector<u64> presented_hashes;
+
+void present_init(bool zero_copy) {
+    // draw in the texture's own format so the driver never converts
+    SDL_PixelFormat format = display_backend == BACKEND_SDL
+                                 ? native_texture_format()
+                                 : SDL_PIXELFORMAT_ARGB8888;
+    frame_buffer.swap_red_blue = format == SDL_PIXELFORMAT_ABGR8888 ||
+                                 format == SDL_PIXELFORMAT_XBGR8888;
+    frame_buffer.clear_color = frame_buffer.native(frame_buffer.clear_color);
+
+    for (Framebuffer &spare : spares) {
+        spare.clear_color = frame_buffer.clear_color;
+        spare.swap_red_blue = frame_buffer.swap_red_blue;
+        spare.resize(frame_buffer.width, frame_buffer.height);
+    }
+
+    if (display_backend == BACKEND_OFFSCREEN) {
+        initialize_offscreen(frame_buffer.width, frame_buffer.height);
+        return;
+    }
+
+    frame_buffer_texture =
+        SDL_CreateTexture(renderer, format, SDL_TEXTUREACCESS_STREAMING,
+                          frame_buffer.width, frame_buffer.height);
+
+    if (!zero_copy) {
+        return;
+    }
+
+    Framebuffer *buffers[] = {&frame_buffer, &spares[0], &spares[1]};
+    for (Framebuffer *buffer : buffers) {
+        SDL_Texture *texture =
+            SDL_CreateTexture(renderer, format, SDL_TEXTUREACCESS_STREAMING,
+                              buffer->width, buffer->height);
+        buffer->texture = texture;
+        if (!texture || !lock_frame_buffer(*buffer)) {
+            buffer->detach_color();
+            SDL_DestroyTexture(texture);
+        }
+    }
+}
+
+bool submit_frame() {
+    std::unique_lock lock(present_mutex);
+
+    usize slot = PRESENT_SPARE_COUNT;
+    present_condition.wait(lock, [&] {
+        for (usize i = 0; i < PRESENT_SPARE_COUNT; i++) {
+            if (slot_states[i] == SLOT_FREE) {
+                slot = i;
+                return true;
+            }
+        }
+        return stopped;
+    });
+    if (stopped) {
+        return false;
+    }
+
+    frame_buffer.swap(spares[slot]);
+    slot_states[slot] = SLOT_QUEUED;
+    queued_slots.push_back(slot);
+
+    lock.unlock();
+    present_condition.notify_all();
+    return true;
+}
+
+bool present_frame(u32 timeout_ms) {
+    std::unique_lock lock(present_mutex);
+    present_condition.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                               [] { return stopped || !queued_slots.empty(); });
+    if (queued_slots.empty()) {
+        return false;
+    }
+
+    usize slot = queued_slots.front();
+    queued_slots.pop_front();
+    slot_states[slot] = SLOT_PRESENTING;
+    lock.unlock();
+
+    Framebuffer &buffer = spares[slot];
+    if (buffer.texture) {
+        render_locked_frame_buffer(buffer);
+        SDL_RenderPresent(renderer);
+
+        // frame_buffer_texture fell behind, a later upload sends everything
+        presented_written.assign(buffer.written.size(), 1);
+        presented_hashes.clear();
+
+        // relock for the next frame drawn into this buffer, the texture
+        // memory may move between locks
+        if (!lock_frame_buffer(buffer)) {
+            SDL_Texture *texture = buffer.texture;
+            buffer.detach_color();
+            SDL_DestroyTexture(texture);
+        }
+    } else {
+        // dirty flags are relative to what this buffer uploaded last, but
+        // the target holds the previous frame, which came from another
+        // buffer. whatever was drawn there has to be replaced too
+        // tiles drawn from the same inputs as the ones on screen already
+        // match and are skipped
+        if (presented_written.size() != buffer.written.size()) {
+            presented_written.assign(buffer.written.size(), 1);
+        }
+        bool same_size = presented_hashes.size() == buffer.tile_hash.size();
+        for (usize tile = 0; tile < buffer.dirty.size(); tile++) {
+            u64 hash = buffer.tile_hash[tile];
+            if (same_size && hash != 0 && hash == presented_hashes[tile]) {
+                buffer.dirty[tile] = 0;
+            } else {
+                buffer.dirty[tile] |= presented_written[tile];
+            }
+        }
+        presented_written = buffer.written;
+        presented_hashes = buffer.tile_hash;
+
+        if (display_backend == BACKEND_OFFSCREEN) {
+            render_offscreen(buffer);
+        } else {
+            render_frame_buffer(buffer);
+            SDL_RenderPresent(renderer);
+        }
+    }
+
+    lock.lock();
+    slot_states[slot] = SLOT_FREE;
+    lock.unlock();
+    present_condition.notify_all();
+    return true;
+}
+
+void present_stop() {
+    {
+        std::lock_guard lock(present_mutex);
+        stopped = true;
+    }
+    present_condition.notify_all();
+}
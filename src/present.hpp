@@ -0,0 +1,30 @@
+#pragma once
+
+#include "core.hpp"
+#include "framebuffer.hpp"
+
+// framebuffers waiting or on screen besides frame_buffer, which makes three
+#define PRESENT_SPARE_COUNT 2
+
+// finished frames move from the render thread, which draws into
+// frame_buffer, to the thread owning the renderer. while one frame is
+// uploaded and presented the next can wait and a third can be drawn
+
+// size the spares like frame_buffer and create the textures, before either
+// thread starts. with zero_copy every buffer draws straight into a locked
+// texture of its own, buffers that fail to lock one upload into
+// frame_buffer_texture instead. the offscreen backend ignores zero_copy
+void present_init(bool zero_copy);
+
+// render thread: queue frame_buffer for presenting and continue in a free
+// buffer, waiting while every spare is queued or on screen. the buffer
+// comes back with its old contents and flags, so it still needs a clear.
+// false once present_stop() was called
+bool submit_frame();
+
+// renderer thread: upload and present the oldest queued frame, waiting up
+// to timeout_ms for one. false if nothing was presented
+bool present_frame(u32 timeout_ms);
+
+// wake a render thread waiting in submit_frame() for good
+void present_stop();
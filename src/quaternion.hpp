@@ -0,0 +1,55 @@
+#pragma once
+
+#include "core.hpp"
+#include "vector.hpp"
+
+struct Quatf {
+    union {
+        struct {
+            f32 x, y, z, w;
+        };
+        f32 data[4];
+    };
+
+    Quatf() : x{0}, y{0}, z{0}, w{1} {}
+
+    Quatf(f32 x, f32 y, f32 z, f32 w) : x{x}, y{y}, z{z}, w{w} {}
+
+    static constexpr usize size() { return 4; }
+
+    f32 &operator[](usize i) { return data[i]; }
+    f32 operator[](usize i) const { return data[i]; }
+
+    // hamilton product, applies b then a
+    friend Quatf operator*(const Quatf &a, const Quatf &b) {
+        return {
+            a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+            a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+            a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+            a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z,
+        };
+    }
+
+    friend f32 len_squared(const Quatf &q) {
+        return q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w;
+    }
+
+    friend Quatf norm(const Quatf &q) {
+        f32 inv_len = 1 / sqrt(len_squared(q));
+        return {q.x * inv_len, q.y * inv_len, q.z * inv_len, q.w * inv_len};
+    }
+
+    static Quatf axis_angle(Vec3 axis, f32 angle) {
+        Vec3 a = norm(axis) * sin(angle / 2);
+        return {a.x, a.y, a.z, cos(angle / 2)};
+    }
+
+    // same as rotation_x * rotation_y * rotation_z, x is applied first.
+    // rotation_y turns the other way around y than axis_angle does
+    static Quatf euler(f32 x, f32 y, f32 z) {
+        return axis_angle({0, 0, 1}, z) * axis_angle({0, 1, 0}, -y) *
+               axis_angle({1, 0, 0}, x);
+    }
+};
+
+using Quat = Quatf;
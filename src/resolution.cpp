@@ -0,0 +1,72 @@
+#include "resolution.hpp"
+#include "display.hpp"
+#include "pacer.hpp"
+
+ResolutionScaler resolution_scaler;
+
+// frames that stay this long at a scale before it goes up again
+#define RESOLUTION_COOLDOWN 30
+
+static bool apply_scale(f32 scale) {
+    u32 width = std::max<u32>(1, lround(output_width * scale));
+    u32 height = std::max<u32>(1, lround(output_height * scale));
+    if (width == window_width && height == window_height) {
+        return false;
+    }
+
+    window_width = width;
+    window_height = height;
+    return true;
+}
+
+void reset_render_scale() {
+    ResolutionScaler &scaler = resolution_scaler;
+    scaler.scale = 1;
+    scaler.smoothed_ms = 0;
+    scaler.cooldown = 0;
+    apply_scale(1);
+}
+
+bool update_render_scale(f64 frame_ms) {
+    ResolutionScaler &scaler = resolution_scaler;
+    if (!scaler.enabled) {
+        return false;
+    }
+
+    // a little under the pacer's period, uncapped aims for 60
+    f64 rate = frame_pacer.target_rate > 0 ? frame_pacer.target_rate : 60;
+    f64 budget_ms = 0.9 * 1000 / rate;
+
+    if (scaler.smoothed_ms == 0) {
+        scaler.smoothed_ms = frame_ms;
+    }
+    scaler.smoothed_ms += (frame_ms - scaler.smoothed_ms) * 0.1;
+    if (scaler.cooldown > 0) {
+        scaler.cooldown--;
+    }
+
+    // fill cost goes with the pixel count, the square of the scale. drop
+    // at once when a frame overruns, rise slowly once there is headroom,
+    // and leave the scale alone in between
+    f32 scale = scaler.scale;
+    if (frame_ms > budget_ms) {
+        scale = scaler.scale * sqrt(budget_ms / frame_ms);
+        scale = floor(scale / scaler.step) * scaler.step;
+    } else if (scaler.cooldown == 0 && scaler.smoothed_ms < 0.75 * budget_ms) {
+        scale = scaler.scale + scaler.step;
+    }
+    scale = std::clamp(scale, scaler.min_scale, 1.0f);
+
+    if (scale == scaler.scale) {
+        return false;
+    }
+
+    // the old times do not hold at the new size
+    f32 area_ratio = (scale * scale) / (scaler.scale * scaler.scale);
+    scaler.smoothed_ms *= area_ratio;
+    scaler.scale = scale;
+    scaler.cooldown = RESOLUTION_COOLDOWN;
+    scaler.changes++;
+
+    return apply_scale(scale);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "core.hpp"
+
+// picks the render size from how long frames take. window_width and
+// window_height become the render size, output_width and output_height
+// stay the size frames are scaled up to when presented
+struct ResolutionScaler {
+    bool enabled = false;
+    f32 scale = 1;         // render over output size, on both axes
+    f32 min_scale = 0.5;
+    f32 step = 1.0 / 16;   // scales are multiples of this
+
+    f64 smoothed_ms = 0;   // running mean of the frame time
+    u32 cooldown = 0;      // frames before the scale may go up again
+    u32 changes = 0;
+};
+
+extern ResolutionScaler resolution_scaler;
+
+// feed the cpu time of the last frame, true if the render size changed
+bool update_render_scale(f64 frame_ms);
+
+// back to the output size
+void reset_render_scale();
@@ -0,0 +1,98 @@
+#include "scene.hpp"
+
+std::vector<TransformNode> transform_nodes;
+std::vector<Mat4x4f> world_matrices;
+
+// lowest index of a dirty node, everything before it is up to date
+usize first_dirty = SIZE_MAX;
+u32 update_pass = 0;
+
+static void mark_dirty(u32 node) {
+    transform_nodes[node].dirty = true;
+    first_dirty = std::min<usize>(first_dirty, node);
+}
+
+u32 add_transform_node(i32 parent) {
+    assert(parent < static_cast<i32>(transform_nodes.size()));
+
+    TransformNode node{};
+    node.parent = parent;
+    transform_nodes.push_back(node);
+    world_matrices.push_back(Mat4x4f::identity());
+
+    u32 index = transform_nodes.size() - 1;
+    mark_dirty(index);
+    return index;
+}
+
+void set_rotation(u32 node, Quat rotation) {
+    transform_nodes[node].rotation = rotation;
+    mark_dirty(node);
+}
+
+void set_scale(u32 node, Vec3 scale) {
+    transform_nodes[node].scale = scale;
+    mark_dirty(node);
+}
+
+void set_translate(u32 node, Vec3 translate) {
+    transform_nodes[node].translate = translate;
+    mark_dirty(node);
+}
+
+// scale, then rotate, then translate, built directly from the quaternion
+// so no trig or matrix multiplies are needed
+static Mat4x4f compose_trs(const TransformNode &node) {
+    const Quat &q = node.rotation;
+    f32 xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+    f32 xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+    f32 wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+    f32 r[3][3] = {
+        {1 - 2 * (yy + zz), 2 * (xy - wz), 2 * (xz + wy)},
+        {2 * (xy + wz), 1 - 2 * (xx + zz), 2 * (yz - wx)},
+        {2 * (xz - wy), 2 * (yz + wx), 1 - 2 * (xx + yy)},
+    };
+
+    Mat4x4f m = Mat4x4f::identity();
+    for (usize row = 0; row < 3; row++) {
+        for (usize col = 0; col < 3; col++) {
+            m[row][col] = r[row][col] * node.scale[col];
+        }
+        m[row][3] = node.translate[row];
+    }
+    return m;
+}
+
+void update_transforms() {
+    if (first_dirty >= transform_nodes.size()) {
+        return;
+    }
+
+    update_pass++;
+
+    for (usize i = first_dirty; i < transform_nodes.size(); i++) {
+        TransformNode &node = transform_nodes[i];
+
+        bool parent_changed = node.parent >= 0 &&
+                              transform_nodes[node.parent].updated_in ==
+                                  update_pass;
+        if (!node.dirty && !parent_changed) {
+            continue;
+        }
+
+        if (node.dirty) {
+            node.local = compose_trs(node);
+            node.dirty = false;
+        }
+
+        // local is applied first, then the parent
+        world_matrices[i] = node.parent >= 0
+                                ? node.local * world_matrices[node.parent]
+                                : node.local;
+        node.version++;
+        node.updated_in = update_pass;
+    }
+
+    first_dirty = SIZE_MAX;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "core.hpp"
+#include "matrix.hpp"
+#include "quaternion.hpp"
+#include "vector.hpp"
+
+struct TransformNode {
+    Quat rotation;
+    Vec3 scale = {1, 1, 1};
+    Vec3 translate = {0, 0, 0};
+    i32 parent = -1;
+
+    Mat4x4f local = Mat4x4f::identity();
+    bool dirty = true;  // local needs rebuilding
+    u32 version = 0;    // bumped whenever the world matrix changes
+    u32 updated_in = 0; // update_transforms() pass that last changed world
+};
+
+// nodes are stored parents first so one forward pass updates the hierarchy.
+// world matrices live in their own array so runs of nodes can be passed
+// straight to draw_mesh_instanced()
+extern std::vector<TransformNode> transform_nodes;
+extern std::vector<Mat4x4f> world_matrices;
+
+u32 add_transform_node(i32 parent = -1);
+
+void set_rotation(u32 node, Quat rotation);
+void set_scale(u32 node, Vec3 scale);
+void set_translate(u32 node, Vec3 translate);
+
+// rebuild local and world matrices of dirty nodes and their descendants,
+// nothing is touched when no node changed
+void update_transforms();
@@ -0,0 +1,195 @@
+#include "shadow.hpp"
+#include "arena.hpp"
+#include "draw.hpp"
+#include "scene.hpp"
+
+ShadowMap shadow_map;
+
+static bool same_position(Vec3 a, Vec3 b) {
+    return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+static bool rect_empty(ClipRect r) { return r.x0 > r.x1 || r.y0 > r.y1; }
+
+static ClipRect rect_union(ClipRect a, ClipRect b) {
+    if (rect_empty(a)) {
+        return b;
+    }
+    if (rect_empty(b)) {
+        return a;
+    }
+    return {std::min(a.x0, b.x0), std::min(a.y0, b.y0), std::max(a.x1, b.x1),
+            std::max(a.y1, b.y1)};
+}
+
+static bool rects_overlap(ClipRect a, ClipRect b) {
+    return a.x0 <= b.x1 && b.x0 <= a.x1 && a.y0 <= b.y1 && b.y0 <= a.y1;
+}
+
+// orthographic view of the region along the light, scaled straight to texels
+static Mat4x4f shadow_light_matrix(Vec3 direction, Vec3 center, f32 radius) {
+    Vec3 up = fabs(direction.y) < 0.99 ? Vec3{0, 1, 0} : Vec3{1, 0, 0};
+    Vec3 eye = center - norm(direction) * (radius * 2);
+
+    Mat4x4f view = Mat4x4f::look_along(eye, direction, up);
+    Mat4x4f ortho =
+        Mat4x4f::orthographic(-radius, radius, -radius, radius, 0, radius * 4);
+    f32 half_size = SHADOW_MAP_SIZE / 2.0;
+    Mat4x4f texels =
+        Mat4x4f::translate(1, 1, 0) * Mat4x4f::scale(half_size, half_size);
+
+    return view * ortho * texels;
+}
+
+// texels the caster's bounding sphere can touch
+static ClipRect caster_rect(const ShadowCaster &caster) {
+    const Mesh &mesh = *caster.mesh;
+    const Mat4x4f &world = world_matrices[caster.node];
+
+    f32 scale_squared = 0;
+    for (usize col = 0; col < 3; col++) {
+        f32 s = world[0][col] * world[0][col] + world[1][col] * world[1][col] +
+                world[2][col] * world[2][col];
+        scale_squared = std::max(scale_squared, s);
+    }
+
+    Vec4 center = shadow_map.light_matrix * (world * Vec4{mesh.sphere_center});
+    f32 radius = mesh.sphere_radius * sqrt(scale_squared) *
+                 (SHADOW_MAP_SIZE / (2 * shadow_map.radius));
+
+    // one texel of slack for the pixel snapping in the rasterizer
+    ClipRect rect = {
+        static_cast<i32>(floor(center.x - radius)) - 1,
+        static_cast<i32>(floor(center.y - radius)) - 1,
+        static_cast<i32>(ceil(center.x + radius)) + 1,
+        static_cast<i32>(ceil(center.y + radius)) + 1,
+    };
+    rect.x0 = std::max(rect.x0, 0);
+    rect.y0 = std::max(rect.y0, 0);
+    rect.x1 = std::min(rect.x1, SHADOW_MAP_SIZE - 1);
+    rect.y1 = std::min(rect.y1, SHADOW_MAP_SIZE - 1);
+    return rect;
+}
+
+static void render_caster(const ShadowCaster &caster, ClipRect clip) {
+    const Mesh &mesh = *caster.mesh;
+    const Mat4x4f m = dequantize_matrix(mesh) * world_matrices[caster.node] *
+                      shadow_map.light_matrix;
+
+    usize vertex_count = mesh_vertex_count(mesh);
+    ArenaVector<Vec4> positions(vertex_count, frame_arena);
+    for (usize v = 0; v < vertex_count; v++) {
+        positions[v] = m * Vec4{mesh_vertex(mesh, v)};
+    }
+
+    // no culling, back faces cast shadows too
+    usize index_count = mesh_index_count(mesh);
+    for (usize i = 0; i + 2 < index_count; i += 3) {
+        draw_depth_triangle(positions[mesh_index(mesh, i)],
+                            positions[mesh_index(mesh, i + 1)],
+                            positions[mesh_index(mesh, i + 2)],
+                            shadow_map.depth.data(), SHADOW_MAP_SIZE, clip);
+    }
+}
+
+static void clear_rect(ClipRect rect) {
+    for (i32 y = rect.y0; y <= rect.y1; y++) {
+        f32 *row = &shadow_map.depth[y * SHADOW_MAP_SIZE];
+        std::fill(row + rect.x0, row + rect.x1 + 1, 1.0f);
+    }
+}
+
+void update_shadow_map(std::span<const ShadowCaster> casters) {
+    ShadowMap &map = shadow_map;
+
+    bool same_casters = casters.size() == map.casters.size();
+    for (usize i = 0; same_casters && i < casters.size(); i++) {
+        same_casters = casters[i].mesh == map.casters[i].mesh &&
+                       casters[i].node == map.casters[i].node;
+    }
+
+    bool full = !map.valid || !same_casters ||
+                !same_position(light, map.rendered_light) ||
+                !same_position(map.center, map.rendered_center) ||
+                map.radius != map.rendered_radius;
+
+    if (full) {
+        map.depth.assign(SHADOW_MAP_SIZE * SHADOW_MAP_SIZE, 1.0f);
+        map.light_matrix = shadow_light_matrix(light, map.center, map.radius);
+
+        map.casters.assign(casters.begin(), casters.end());
+        map.caster_versions.resize(casters.size());
+        map.caster_rects.resize(casters.size());
+
+        ClipRect all = full_rect(SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
+        for (usize i = 0; i < casters.size(); i++) {
+            map.caster_versions[i] = transform_nodes[casters[i].node].version;
+            map.caster_rects[i] = caster_rect(casters[i]);
+            render_caster(casters[i], all);
+        }
+
+        map.valid = true;
+        map.rendered_light = light;
+        map.rendered_center = map.center;
+        map.rendered_radius = map.radius;
+        map.full_renders++;
+        return;
+    }
+
+    // region that moved casters covered before and cover now
+    ClipRect dirty = {0, 0, -1, -1};
+    for (usize i = 0; i < casters.size(); i++) {
+        u32 version = transform_nodes[casters[i].node].version;
+        if (version == map.caster_versions[i]) {
+            continue;
+        }
+
+        ClipRect rect = caster_rect(casters[i]);
+        dirty = rect_union(dirty, rect_union(map.caster_rects[i], rect));
+        map.caster_versions[i] = version;
+        map.caster_rects[i] = rect;
+    }
+
+    if (rect_empty(dirty)) {
+        return;
+    }
+
+    // redraw every caster reaching into the region, clipped to it
+    clear_rect(dirty);
+    for (usize i = 0; i < casters.size(); i++) {
+        if (rects_overlap(map.caster_rects[i], dirty)) {
+            render_caster(casters[i], dirty);
+        }
+    }
+
+    map.partial_renders++;
+}
+
+f32 sample_shadow(Vec3 position) {
+    if (!shadow_map.valid) {
+        return 1;
+    }
+
+    Vec4 p = shadow_map.light_matrix * Vec4{position};
+    i32 x = floor(p.x);
+    i32 y = floor(p.y);
+    f32 depth = p.z - SHADOW_BIAS;
+
+    const i32 last = SHADOW_MAP_SIZE - 1;
+    if (x < 0 || y < 0 || x > last || y > last || p.z > 1) {
+        return 1;
+    }
+
+    u32 lit = 0;
+    u32 taps = 0;
+    for (i32 dy = -SHADOW_PCF_RADIUS; dy <= SHADOW_PCF_RADIUS; dy++) {
+        for (i32 dx = -SHADOW_PCF_RADIUS; dx <= SHADOW_PCF_RADIUS; dx++) {
+            i32 sx = std::clamp(x + dx, 0, last);
+            i32 sy = std::clamp(y + dy, 0, last);
+            lit += depth <= shadow_map.depth[sx + sy * SHADOW_MAP_SIZE];
+            taps++;
+        }
+    }
+
+    return lit / static_cast<f32>(taps);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "core.hpp"
+#include "matrix.hpp"
+#include "mesh.hpp"
+#include "triangle.hpp"
+#include "vector.hpp"
+
+#define SHADOW_MAP_SIZE 1024
+// pcf kernel is (2 * radius + 1)^2 texels
+#define SHADOW_PCF_RADIUS 1
+// depth offset against self shadowing, in shadow map depth units
+#define SHADOW_BIAS 0.002f
+// light left in fully shadowed texels
+#define SHADOW_AMBIENT 0.35f
+
+struct ShadowCaster {
+    const Mesh *mesh;
+    u32 node; // transform node, its version tells when the caster moved
+};
+
+// depth of the scene seen from the directional light. only casters that
+// moved since the last update are re-rendered, into the union of their old
+// and new footprints, and nothing is drawn while the scene is static
+struct ShadowMap {
+    std::vector<f32> depth;
+    Mat4x4f light_matrix; // world to texel x, y and depth z
+
+    // shadows are only computed inside this sphere
+    Vec3 center = {0, 0, 5};
+    f32 radius = 4;
+
+    // what the map was last rendered with
+    bool valid = false;
+    Vec3 rendered_light = {0, 0, 0};
+    Vec3 rendered_center = {0, 0, 0};
+    f32 rendered_radius = 0;
+    std::vector<ShadowCaster> casters;
+    std::vector<u32> caster_versions;
+    std::vector<ClipRect> caster_rects;
+
+    u32 full_renders = 0;
+    u32 partial_renders = 0;
+};
+
+extern ShadowMap shadow_map;
+
+// bring the map up to date with the casters and the global light, call
+// after update_transforms()
+void update_shadow_map(std::span<const ShadowCaster> casters);
+
+// lit fraction of the pcf kernel around a world position, 1 outside the map
+f32 sample_shadow(Vec3 position);
@@ -0,0 +1,119 @@
+#include "shared_frames.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+static SharedFrameRing *ring = nullptr;
+static usize ring_size = 0;
+static std::string ring_name;
+static u64 published = 0;
+
+static u64 monotonic_ns() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<u64>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+// whole pages, so every slot's pixels start page aligned
+static usize page_align(usize bytes) {
+    usize page = sysconf(_SC_PAGESIZE);
+    return (bytes + page - 1) / page * page;
+}
+
+bool open_shared_frames(const char *name, u32 max_width, u32 max_height) {
+    usize header_size = page_align(sizeof(SharedFrameRing));
+    usize slot_size =
+        page_align(static_cast<usize>(max_width) * max_height * sizeof(u32));
+    usize size = header_size + slot_size * SHARED_FRAME_SLOTS;
+
+    // a stale object of an earlier run could have another layout
+    shm_unlink(name);
+    i32 fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        fprintf(stderr, "Error creating shared memory %s: %s\n", name,
+                strerror(errno));
+        return false;
+    }
+
+    void *memory = MAP_FAILED;
+    if (ftruncate(fd, size) == 0) {
+        memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                      0);
+    }
+    close(fd);
+    if (memory == MAP_FAILED) {
+        fprintf(stderr, "Error mapping shared memory %s: %s\n", name,
+                strerror(errno));
+        shm_unlink(name);
+        return false;
+    }
+
+    // new pages are zero, so every sequence reads as not ready
+    ring = static_cast<SharedFrameRing *>(memory);
+    ring->version = SHARED_FRAME_VERSION;
+    ring->slot_count = SHARED_FRAME_SLOTS;
+    ring->max_width = max_width;
+    ring->max_height = max_height;
+    for (usize i = 0; i < SHARED_FRAME_SLOTS; i++) {
+        ring->slots[i].pixel_offset = header_size + slot_size * i;
+    }
+
+    // readers check the magic last, once everything above is in place
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(ring->magic, "RPFRAMES", sizeof(ring->magic));
+
+    ring_size = size;
+    ring_name = name;
+    published = 0;
+    return true;
+}
+
+void publish_frame(Framebuffer &buffer, u64 render_start) {
+    if (!ring || buffer.width > ring->max_width ||
+        buffer.height > ring->max_height) {
+        return;
+    }
+
+    u64 sequence = ++published;
+    SharedFrameSlot &slot = ring->slots[sequence % SHARED_FRAME_SLOTS];
+    slot.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    // lazy clears have to be in the plane before it is read
+    buffer.resolve();
+
+    // rows go out in the buffer's own format, readers swizzle if they care
+    u8 *pixels = reinterpret_cast<u8 *>(ring) + slot.pixel_offset;
+    usize row_bytes = static_cast<usize>(buffer.width) * sizeof(u32);
+    for (u32 y = 0; y < buffer.height; y++) {
+        memcpy(pixels + y * row_bytes, &buffer.pixel(0, y), row_bytes);
+    }
+
+    u64 now = monotonic_ns();
+    u64 elapsed = SDL_GetPerformanceCounter() - render_start;
+    slot.width = buffer.width;
+    slot.height = buffer.height;
+    slot.pitch = row_bytes;
+    slot.format = buffer.swap_red_blue ? SDL_PIXELFORMAT_ABGR8888
+                                       : SDL_PIXELFORMAT_ARGB8888;
+    slot.render_start_ns =
+        now - static_cast<u64>(elapsed * 1e9 / SDL_GetPerformanceFrequency());
+    slot.publish_ns = now;
+
+    slot.sequence.store(sequence, std::memory_order_release);
+    ring->latest.store(sequence, std::memory_order_release);
+}
+
+void close_shared_frames() {
+    if (!ring) {
+        return;
+    }
+
+    munmap(ring, ring_size);
+    shm_unlink(ring_name.c_str());
+    ring = nullptr;
+}
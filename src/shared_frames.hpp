@@ -0,0 +1,52 @@
+#pragma once
+
+#include "core.hpp"
+#include "framebuffer.hpp"
+
+#include <atomic>
+
+// finished frames published into a posix shared memory object, for other
+// processes on the host to read in place. the object starts with a
+// SharedFrameRing, every slot's pixels follow at pixel_offset
+
+#define SHARED_FRAME_SLOTS 3
+#define SHARED_FRAME_VERSION 1
+
+static_assert(std::atomic<u64>::is_always_lock_free);
+
+struct SharedFrameSlot {
+    // sequence of the frame in the slot, 0 while it is being written. read
+    // it before and after using the pixels, if it changed in between the
+    // slot was reused under the reader
+    std::atomic<u64> sequence;
+    u32 width;
+    u32 height;
+    u32 pitch;  // bytes from one row to the next
+    u32 format; // SDL_PixelFormat of the pixels
+    // CLOCK_MONOTONIC, comparable between processes
+    u64 render_start_ns;
+    u64 publish_ns;
+    u64 pixel_offset; // from the start of the object
+};
+
+struct SharedFrameRing {
+    char magic[8]; // "RPFRAMES"
+    u32 version;
+    u32 slot_count;
+    u32 max_width;
+    u32 max_height;
+    // newest complete frame, it lives in slot latest % slot_count. 0 until
+    // the first one is published
+    std::atomic<u64> latest;
+    SharedFrameSlot slots[SHARED_FRAME_SLOTS];
+};
+
+// create the object name (e.g. "/rasterizer") with room for frames up to
+// max_width x max_height. it is removed again by close_shared_frames()
+bool open_shared_frames(const char *name, u32 max_width, u32 max_height);
+
+// render thread: copy buffer into the oldest slot and make it the latest.
+// render_start is the performance counter when the frame was begun
+void publish_frame(Framebuffer &buffer, u64 render_start);
+
+void close_shared_frames();
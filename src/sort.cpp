@@ -0,0 +1,64 @@
+#include "sort.hpp"
+
+#define RADIX_BITS 8
+#define RADIX_SIZE (1 << RADIX_BITS)
+#define RADIX_PASSES (32 / RADIX_BITS)
+
+u32 depth_key_back_to_front(f32 depth) {
+    // flip so unsigned order matches float order, negative floats need all
+    // bits flipped since their magnitude grows the wrong way
+    u32 bits = std::bit_cast<u32>(depth);
+    u32 mask = (bits & 0x80000000) ? 0xffffffff : 0x80000000;
+    u32 ascending = bits ^ mask;
+
+    return ~ascending;
+}
+
+void radix_sort(std::span<DepthKey> keys, std::span<DepthKey> scratch) {
+    assert(scratch.size() >= keys.size());
+
+    usize n = keys.size();
+    if (n < 2) {
+        return;
+    }
+
+    // histograms for every pass in one read over the keys
+    u32 histogram[RADIX_PASSES][RADIX_SIZE] = {};
+    for (usize i = 0; i < n; i++) {
+        u32 key = keys[i].key;
+        for (usize pass = 0; pass < RADIX_PASSES; pass++) {
+            histogram[pass][(key >> (pass * RADIX_BITS)) & (RADIX_SIZE - 1)]++;
+        }
+    }
+
+    DepthKey *src = keys.data();
+    DepthKey *dst = scratch.data();
+
+    for (usize pass = 0; pass < RADIX_PASSES; pass++) {
+        u32 *counts = histogram[pass];
+        u32 shift = pass * RADIX_BITS;
+
+        // every key has the same digit, nothing to move
+        if (counts[(src[0].key >> shift) & (RADIX_SIZE - 1)] == n) {
+            continue;
+        }
+
+        u32 offset = 0;
+        for (usize digit = 0; digit < RADIX_SIZE; digit++) {
+            u32 count = counts[digit];
+            counts[digit] = offset;
+            offset += count;
+        }
+
+        for (usize i = 0; i < n; i++) {
+            u32 digit = (src[i].key >> shift) & (RADIX_SIZE - 1);
+            dst[counts[digit]++] = src[i];
+        }
+
+        std::swap(src, dst);
+    }
+
+    if (src != keys.data()) {
+        std::copy(src, src + n, keys.data());
+    }
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "core.hpp"
+
+// compact sort entry, index points back into the array being ordered
+struct DepthKey {
+    u32 key;
+    u32 index;
+};
+
+// maps depth to a key whose ascending order is far to near
+u32 depth_key_back_to_front(f32 depth);
+
+// stable lsd radix sort by key, scratch must be at least keys.size()
+void radix_sort(std::span<DepthKey> keys, std::span<DepthKey> scratch);
@@ -0,0 +1,383 @@
+#include "stream.hpp"
+#include "video.hpp"
+
+#include <condition_variable>
+#include <errno.h>
+#include <mutex>
+#include <signal.h>
+#include <string.h>
+
+StreamStats stream_stats;
+
+static FILE *stream_file = nullptr;
+static bool stream_is_pipe = false;
+static StreamFormat stream_format = STREAM_Y4M;
+static u32 stream_width = 0;
+static u32 stream_height = 0;
+
+// frames in order, an empty one repeats the frame before it. spare copies
+// wait in the pool
+static std::deque<std::vector<u32>> queued_frames;
+static std::vector<std::vector<u32>> frame_pool;
+static bool stream_stopping = false;
+static std::mutex stream_mutex;
+static std::condition_variable stream_condition;
+static std::thread stream_thread;
+
+// only touched by the stream thread
+static std::vector<u32> previous_frame;
+static u32 frames_since_keyframe = 0;
+static std::vector<u8> encoded;
+static std::vector<std::vector<u8>> band_tokens;
+static bool write_failed = false;
+// what a reader of the delta stream ends up with, see check_delta_frame()
+static std::vector<u32> decoded_frame;
+
+// helpers of the stream thread, started with the stream. band 0 is done
+// by the stream thread itself, band i by band_workers[i - 1]
+static std::vector<std::thread> band_workers;
+static std::function<void(u32, u32, u32)> band_job;
+static u32 band_rows = 0;
+static u32 band_total_rows = 0;
+static u64 band_generation = 0;
+static u32 bands_left = 0;
+static bool bands_stopping = false;
+static std::mutex band_mutex;
+static std::condition_variable band_start;
+static std::condition_variable band_done;
+
+static u32 band_count() { return band_workers.size() + 1; }
+
+static void run_band(u32 band) {
+    u32 first = std::min(band * band_rows, band_total_rows);
+    u32 last = std::min(first + band_rows, band_total_rows);
+    if (first < last) {
+        band_job(band, first, last);
+    }
+}
+
+static void band_loop(u32 band) {
+    u64 generation = 0;
+    while (true) {
+        {
+            std::unique_lock lock(band_mutex);
+            band_start.wait(lock, [&] {
+                return bands_stopping || band_generation != generation;
+            });
+            if (bands_stopping) {
+                return;
+            }
+            generation = band_generation;
+        }
+
+        run_band(band);
+
+        std::lock_guard lock(band_mutex);
+        if (--bands_left == 0) {
+            band_done.notify_one();
+        }
+    }
+}
+
+static void start_band_workers() {
+    u32 thread_count = std::clamp(std::thread::hardware_concurrency(), 1u, 8u);
+    bands_stopping = false;
+    for (u32 band = 1; band < thread_count; band++) {
+        band_workers.emplace_back(band_loop, band);
+    }
+}
+
+static void stop_band_workers() {
+    {
+        std::lock_guard lock(band_mutex);
+        bands_stopping = true;
+    }
+    band_start.notify_all();
+    for (std::thread &worker : band_workers) {
+        worker.join();
+    }
+    band_workers.clear();
+}
+
+// split rows into bands of whole row pairs and convert them on every
+// helper at once, job(band, first_row, last_row)
+static void for_each_band(u32 rows, std::function<void(u32, u32, u32)> job) {
+    {
+        std::lock_guard lock(band_mutex);
+        band_job = std::move(job);
+        band_total_rows = rows;
+        band_rows = ((rows + band_count() - 1) / band_count() + 1) & ~1u;
+        bands_left = band_workers.size();
+        band_generation++;
+    }
+    band_start.notify_all();
+
+    run_band(0);
+
+    std::unique_lock lock(band_mutex);
+    band_done.wait(lock, [] { return bands_left == 0; });
+}
+
+static void write_stream(std::span<const u8> data) {
+    if (write_failed) {
+        return;
+    }
+    if (fwrite(data.data(), 1, data.size(), stream_file) != data.size()) {
+        fprintf(stderr, "Error writing stream: %s\n", strerror(errno));
+        write_failed = true;
+        return;
+    }
+    stream_stats.bytes += data.size();
+}
+
+static void encode_y4m(const std::vector<u32> &pixels) {
+    const char frame_line[] = "FRAME\n";
+    const usize line_size = sizeof(frame_line) - 1;
+    encoded.resize(line_size + y4m_frame_size(stream_width, stream_height));
+    std::copy(frame_line, frame_line + line_size, encoded.begin());
+
+    ImageView view = {pixels.data(), stream_width, stream_height,
+                      stream_width};
+    for_each_band(stream_height, [&](u32, u32 first, u32 last) {
+        convert_yuv420(view, first, last, encoded.data() + line_size);
+    });
+}
+
+static void put_delta_header(u32 flags, usize payload_size) {
+    DeltaHeader header = {{'R', 'P', 'D', 'F'}, stream_width, stream_height,
+                          flags, static_cast<u32>(payload_size)};
+    const u8 *bytes = reinterpret_cast<const u8 *>(&header);
+    encoded.assign(bytes, bytes + sizeof(header));
+}
+
+static void encode_delta_frame(const std::vector<u32> &pixels) {
+    bool keyframe = previous_frame.empty() ||
+                    frames_since_keyframe >= STREAM_KEYFRAME_INTERVAL;
+    const u32 *previous = keyframe ? nullptr : previous_frame.data();
+    frames_since_keyframe = keyframe ? 0 : frames_since_keyframe + 1;
+
+    band_tokens.resize(band_count());
+    for_each_band(stream_height, [&](u32 band, u32 first, u32 last) {
+        band_tokens[band].clear();
+        encode_delta(pixels.data(), previous,
+                     static_cast<usize>(first) * stream_width,
+                     static_cast<usize>(last) * stream_width,
+                     band_tokens[band]);
+    });
+
+    usize payload_size = 0;
+    for (const std::vector<u8> &tokens : band_tokens) {
+        payload_size += tokens.size();
+    }
+    put_delta_header(keyframe ? DELTA_KEYFRAME : 0, payload_size);
+    for (std::vector<u8> &tokens : band_tokens) {
+        encoded.insert(encoded.end(), tokens.begin(), tokens.end());
+        tokens.clear();
+    }
+}
+
+// decode the delta frame in encoded again on top of the frames before it,
+// it has to come out as pixels. only in builds with asserts on
+static void check_delta_frame(const std::vector<u32> &pixels) {
+#ifndef NDEBUG
+    u32 width = 0;
+    u32 height = 0;
+    bool valid = decode_delta(encoded, decoded_frame, width, height);
+    assert(valid && width == stream_width && height == stream_height);
+    assert(decoded_frame == pixels);
+#endif
+}
+
+// y4m has no way to say nothing changed, the last frame is written again
+static void write_repeat() {
+    if (previous_frame.empty()) {
+        return;
+    }
+
+    if (stream_format == STREAM_DELTA) {
+        u32 token = static_cast<u32>(previous_frame.size()) << 2 | DELTA_SKIP;
+        put_delta_header(0, sizeof(token));
+        const u8 *bytes = reinterpret_cast<const u8 *>(&token);
+        encoded.insert(encoded.end(), bytes, bytes + sizeof(token));
+        frames_since_keyframe++;
+        check_delta_frame(previous_frame);
+    }
+    write_stream(encoded);
+}
+
+static void stream_loop() {
+    while (true) {
+        std::vector<u32> pixels;
+        {
+            std::unique_lock lock(stream_mutex);
+            stream_condition.wait(lock, [] {
+                return stream_stopping || !queued_frames.empty();
+            });
+            if (queued_frames.empty()) {
+                break;
+            }
+            pixels = std::move(queued_frames.front());
+            queued_frames.pop_front();
+        }
+
+        if (pixels.empty()) {
+            write_repeat();
+            continue;
+        }
+
+        if (stream_format == STREAM_Y4M) {
+            encode_y4m(pixels);
+        } else {
+            encode_delta_frame(pixels);
+            check_delta_frame(pixels);
+        }
+        write_stream(encoded);
+
+        // the new frame is what the next delta frame refers to, the old one
+        // goes back to the pool
+        previous_frame.swap(pixels);
+        std::lock_guard lock(stream_mutex);
+        frame_pool.push_back(std::move(pixels));
+    }
+    fflush(stream_file);
+}
+
+bool open_stream(const char *destination, StreamFormat format, u32 width,
+                 u32 height, u32 rate) {
+    stream_is_pipe = destination[0] == '|';
+    if (stream_is_pipe) {
+        // a reader going away must not take the renderer down with it
+        signal(SIGPIPE, SIG_IGN);
+        stream_file = popen(destination + 1, "w");
+    } else {
+        stream_file = fopen(destination, "wb");
+    }
+    if (!stream_file) {
+        fprintf(stderr, "Error opening stream %s: %s\n", destination,
+                strerror(errno));
+        return false;
+    }
+
+    stream_format = format;
+    stream_width = width;
+    stream_height = height;
+    stream_stopping = false;
+    write_failed = false;
+    previous_frame.clear();
+    decoded_frame.clear();
+    frame_pool.assign(STREAM_QUEUE_SIZE, {});
+
+    if (format == STREAM_Y4M) {
+        std::vector<u8> header;
+        encode_y4m_header(width, height, std::max(rate, 1u), header);
+        write_stream(header);
+    }
+
+    start_band_workers();
+    stream_thread = std::thread(stream_loop);
+    return true;
+}
+
+// source column of every stream column, for render width columns_width
+static std::vector<u32> columns;
+static u32 columns_width = 0;
+
+// nearest neighbour when the render size is below the stream size
+static void copy_frame(Framebuffer &buffer, std::vector<u32> &pixels) {
+    pixels.resize(static_cast<usize>(stream_width) * stream_height);
+
+    if (columns.size() != stream_width || columns_width != buffer.width) {
+        columns.resize(stream_width);
+        for (u32 x = 0; x < stream_width; x++) {
+            columns[x] = static_cast<u64>(x) * buffer.width / stream_width;
+        }
+        columns_width = buffer.width;
+    }
+
+    for (u32 y = 0; y < stream_height; y++) {
+        u32 row = static_cast<u64>(y) * buffer.height / stream_height;
+        const u32 *source = &buffer.pixel(0, row);
+        u32 *destination = &pixels[static_cast<usize>(y) * stream_width];
+        if (buffer.width == stream_width && !buffer.swap_red_blue) {
+            std::copy(source, source + stream_width, destination);
+            continue;
+        }
+        for (u32 x = 0; x < stream_width; x++) {
+            destination[x] = buffer.native(source[columns[x]]);
+        }
+    }
+}
+
+void stream_frame(Framebuffer &buffer) {
+    if (!stream_file) {
+        return;
+    }
+
+    std::vector<u32> pixels;
+    {
+        std::lock_guard lock(stream_mutex);
+        stream_stats.frames++;
+        if (frame_pool.empty()) {
+            stream_stats.dropped++;
+            queued_frames.emplace_back();
+            stream_condition.notify_one();
+            return;
+        }
+        pixels = std::move(frame_pool.back());
+        frame_pool.pop_back();
+    }
+
+    // lazy clears have to be in the plane before it is read
+    buffer.resolve();
+    copy_frame(buffer, pixels);
+
+    std::lock_guard lock(stream_mutex);
+    queued_frames.push_back(std::move(pixels));
+    stream_condition.notify_one();
+}
+
+void stream_repeat() {
+    if (!stream_file) {
+        return;
+    }
+
+    std::lock_guard lock(stream_mutex);
+    stream_stats.frames++;
+    stream_stats.repeated++;
+    queued_frames.emplace_back();
+    stream_condition.notify_one();
+}
+
+void close_stream() {
+    if (!stream_file) {
+        return;
+    }
+
+    {
+        std::lock_guard lock(stream_mutex);
+        stream_stopping = true;
+    }
+    stream_condition.notify_one();
+    stream_thread.join();
+    stop_band_workers();
+
+    if (stream_is_pipe) {
+        pclose(stream_file);
+    } else {
+        fclose(stream_file);
+    }
+    stream_file = nullptr;
+}
+
+void print_stream_stats() {
+    const StreamStats &stats = stream_stats;
+    if (stats.frames == 0) {
+        return;
+    }
+
+    printf("stream: %llu frames, %llu repeated, %llu dropped, %.1f MB\n",
+           static_cast<unsigned long long>(stats.frames),
+           static_cast<unsigned long long>(stats.repeated),
+           static_cast<unsigned long long>(stats.dropped),
+           stats.bytes / (1024.0 * 1024.0));
+}
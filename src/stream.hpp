@@ -0,0 +1,43 @@
+#pragma once
+
+#include "core.hpp"
+#include "framebuffer.hpp"
+
+// finished frames also go to a file, a fifo or another program, as y4m or
+// as delta frames. the render thread only copies each frame, converting,
+// compressing and writing happen on the stream thread and its helpers
+
+enum StreamFormat {
+    STREAM_Y4M,
+    STREAM_DELTA,
+};
+
+// frame copies waiting for the stream thread, more are sent as repeats
+#define STREAM_QUEUE_SIZE 3
+// delta frames between keyframes
+#define STREAM_KEYFRAME_INTERVAL 120
+
+struct StreamStats {
+    u64 frames = 0;
+    u64 repeated = 0; // unchanged frames sent as the last one again
+    u64 dropped = 0;  // arrived with the queue full, sent as repeats
+    u64 bytes = 0;
+};
+
+extern StreamStats stream_stats;
+
+// destination is a path, or a shell command after a '|' that reads the
+// stream from its stdin. every frame is written at width x height, smaller
+// frames are scaled up. rate goes into the y4m header
+bool open_stream(const char *destination, StreamFormat format, u32 width,
+                 u32 height, u32 rate);
+
+// render thread: copy buffer for the stream, never waits
+void stream_frame(Framebuffer &buffer);
+// render thread: send the last frame again for one that was not drawn
+void stream_repeat();
+
+// write out what is queued and stop the stream thread
+void close_stream();
+
+void print_stream_stats();
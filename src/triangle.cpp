@@ -1,5 +1,10 @@
 #include "triangle.hpp"
 #include "display.hpp"
+#include "light.hpp"
+#include "lightmap.hpp"
+#include "shadow.hpp"
+
+DepthFunc depth_func = DEPTH_OFF;
 
 void draw_triangle(i32 x0, i32 y0, i32 x1, i32 y1, i32 x2, i32 y2, u32 color) {
     draw_line_b(x0, y0, x1, y1, color);
@@ -40,7 +45,9 @@ void draw_filled_triangle(i32 x0, i32 y0, i32 x1, i32 y1, i32 x2, i32 y2,
 
         for (i32 y = y0; y <= my; y++) {
             for (i32 x = x_start; x <= x_end; x++) {
-                draw_pixel(x, y, color);
+                if (!interlace_skip(x, y)) {
+                    draw_pixel(x, y, color);
+                }
             }
             x_start += slope_1;
             x_end += slope_2;
@@ -62,7 +69,9 @@ void draw_filled_triangle(i32 x0, i32 y0, i32 x1, i32 y1, i32 x2, i32 y2,
 
         for (i32 y = y2; y >= y1; y--) {
             for (i32 x = x_start; x <= x_end; x++) {
-                draw_pixel(x, y, color);
+                if (!interlace_skip(x, y)) {
+                    draw_pixel(x, y, color);
+                }
             }
             x_start -= slope_1;
             x_end -= slope_2;
@@ -71,7 +80,7 @@ void draw_filled_triangle(i32 x0, i32 y0, i32 x1, i32 y1, i32 x2, i32 y2,
 }
 
 void draw_texel(i32 x, i32 y, const u32 *texture, Vec4 a, Vec4 b, Vec4 c,
-                Vec2 a_uv, Vec2 b_uv, Vec2 c_uv) {
+                Vec2 a_uv, Vec2 b_uv, Vec2 c_uv, Vec3 intensity) {
     Vec2 p = {static_cast<f32>(x), static_cast<f32>(y)};
 
     Vec3 weights = barycentric_weights(a, b, c, p);
@@ -97,8 +106,60 @@ void draw_texel(i32 x, i32 y, const u32 *texture, Vec4 a, Vec4 b, Vec4 c,
     usize i = texture_width * tex_y + tex_x;
 
     if (i < texture_width * texture_height) {
-        draw_pixel(x, y, texture[i]);
+        u32 color = texture[i];
+        if (intensity.x != 1 || intensity.y != 1 || intensity.z != 1) {
+            color = light_apply_color(color, intensity);
+        }
+        draw_pixel(x, y, color);
+    }
+}
+
+DepthPlane depth_plane(Vec4 a, Vec4 b, Vec4 c) {
+    f32 abx = b.x - a.x;
+    f32 aby = b.y - a.y;
+    f32 acx = c.x - a.x;
+    f32 acy = c.y - a.y;
+    f32 abz = b.z - a.z;
+    f32 acz = c.z - a.z;
+
+    f32 area = abx * acy - aby * acx;
+    if (area == 0) {
+        return {a.z, 0, 0};
     }
+
+    f32 dzdx = (abz * acy - acz * aby) / area;
+    f32 dzdy = (acz * abx - abz * acx) / area;
+    return {a.z - dzdx * a.x - dzdy * a.y, dzdx, dzdy};
+}
+
+// snaps to whole pixels the way the i32 parameters of the other triangle
+// functions do, so both passes build the same plane
+static Vec4 snap_to_pixel(Vec4 v) {
+    return {static_cast<f32>(static_cast<i32>(v.x)),
+            static_cast<f32>(static_cast<i32>(v.y)), v.z, v.w};
+}
+
+void draw_depth_triangle(Vec4 a, Vec4 b, Vec4 c, f32 *depth, u32 width,
+                         u32 height) {
+    draw_depth_triangle(a, b, c, depth, width, full_rect(width, height));
+}
+
+void draw_depth_triangle(Vec4 a, Vec4 b, Vec4 c, f32 *depth, u32 pitch,
+                         ClipRect clip) {
+    a = snap_to_pixel(a);
+    b = snap_to_pixel(b);
+    c = snap_to_pixel(c);
+
+    const DepthPlane plane = depth_plane(a, b, c);
+
+    scan_triangle(a.x, a.y, b.x, b.y, c.x, c.y, clip,
+                  [&](i32 x, i32 y) {
+                      f32 z = depth_at(plane, x, y);
+                      f32 &stored = depth[x + y * pitch];
+                      if (z < stored) {
+                          stored = z;
+                      }
+                  });
 }
 
 Vec3 barycentric_weights(Vec2 a, Vec2 b, Vec2 c, Vec2 p) {
@@ -120,84 +181,160 @@ Vec3 barycentric_weights(Vec2 a, Vec2 b, Vec2 c, Vec2 p) {
     return {alpha, beta, gamma};
 }
 
+// perspective correct weights of pixel x, y, already divided by the
+// interpolated 1 / w
+static Vec3 perspective_weights(Vec4 a, Vec4 b, Vec4 c, i32 x, i32 y) {
+    Vec2 p = {static_cast<f32>(x), static_cast<f32>(y)};
+    Vec3 weights = barycentric_weights(a, b, c, p);
+
+    Vec3 w = {weights.x / a.w, weights.y / b.w, weights.z / c.w};
+    f32 reciprocal_w = w.x + w.y + w.z;
+
+    return w / reciprocal_w;
+}
+
+// shared by the textured entry points. source supplies the world positions
+// for shadows and the lightmap, and is null for the bare textured path. a
+// null texture fills with the base color of source instead
+static void textured_triangle(Vec4 a, Vec4 b, Vec4 c, Vec2 a_uv, Vec2 b_uv,
+                              Vec2 c_uv, const triangle *source,
+                              bool shadowed, const u32 *texture) {
+    const DepthPlane plane = depth_plane(a, b, c);
+
+    auto texel = [&](i32 x, i32 y) {
+        if (interlace_skip(x, y) || frame_buffer.kept(x, y)) {
+            return;
+        }
+
+        if (depth_func != DEPTH_OFF) {
+            f32 z = depth_at(plane, x, y);
+            f32 &stored = frame_buffer.depth_at(x, y);
+
+            if (depth_func == DEPTH_EQUAL) {
+                if (z != stored) {
+                    return;
+                }
+            } else {
+                if (z >= stored) {
+                    return;
+                }
+                stored = z;
+            }
+        }
+
+        Vec3 intensity = {1, 1, 1};
+        if (source) {
+            Vec3 w = perspective_weights(a, b, c, x, y);
+
+            if (source->lightmap) {
+                Vec2 uv[3] = {source->lightmap_uv[0], source->lightmap_uv[1],
+                              source->lightmap_uv[2]};
+                intensity = sample_lightmap(
+                    *source->lightmap, uv[0] * w.x + uv[1] * w.y + uv[2] * w.z);
+            }
+
+            if (shadowed) {
+                Vec3 p[3] = {source->world[0], source->world[1],
+                             source->world[2]};
+                Vec3 position = p[0] * w.x + p[1] * w.y + p[2] * w.z;
+                f32 lit = sample_shadow(position);
+                intensity =
+                    intensity * (SHADOW_AMBIENT + (1 - SHADOW_AMBIENT) * lit);
+            }
+        }
+
+        if (!texture) {
+            draw_pixel(x, y, light_apply_color(source->base_color, intensity));
+            return;
+        }
+
+        draw_texel(x, y, texture, a, b, c, a_uv, b_uv, c_uv, intensity);
+    };
+
+    scan_triangle(a.x, a.y, b.x, b.y, c.x, c.y,
+                  full_rect(window_width, window_height), texel);
+}
+
 void draw_textured_triangle(i32 x0, i32 y0, f32 z0, f32 w0, f32 u0, f32 v0, //
                             i32 x1, i32 y1, f32 z1, f32 w1, f32 u1, f32 v1, //
                             i32 x2, i32 y2, f32 z2, f32 w2, f32 u2, f32 v2,
                             const u32 *texture) {
-    if (y0 > y1) {
-        std::swap(x0, x1);
-        std::swap(y0, y1);
-        std::swap(z0, z1);
-        std::swap(w0, w1);
-        std::swap(u0, u1);
-        std::swap(v0, v1);
-    }
-    if (y1 > y2) {
-        std::swap(x1, x2);
-        std::swap(y1, y2);
-        std::swap(z1, z2);
-        std::swap(w1, w2);
-        std::swap(u1, u2);
-        std::swap(v1, v2);
-    }
-    if (y0 > y1) {
-        std::swap(x0, x1);
-        std::swap(y0, y1);
-        std::swap(z0, z1);
-        std::swap(w0, w1);
-        std::swap(u0, u1);
-        std::swap(v0, v1);
-    }
-
+    // vertices stay in the given order, draw_depth_triangle() must see the
+    // same plane for DEPTH_EQUAL to match
     Vec4 a = {static_cast<f32>(x0), static_cast<f32>(y0), z0, w0};
     Vec4 b = {static_cast<f32>(x1), static_cast<f32>(y1), z1, w1};
     Vec4 c = {static_cast<f32>(x2), static_cast<f32>(y2), z2, w2};
-    Vec2 a_uv = {u0, v0};
-    Vec2 b_uv = {u1, v1};
-    Vec2 c_uv = {u2, v2};
 
-    i32 my = y1;
-    i32 mx = static_cast<f32>((x2 - x0) * (y1 - y0)) / (y2 - y0) + x0;
-    // fill_flat_bottom_triangle();
-    {
-        // y slope
-        f32 slope_1 = static_cast<f32>(x1 - x0) / (y1 - y0);
-        f32 slope_2 = static_cast<f32>(mx - x0) / (my - y0);
+    textured_triangle(a, b, c, {u0, v0}, {u1, v1}, {u2, v2}, nullptr, false,
+                      texture);
+}
 
-        if (slope_1 > slope_2) {
-            std::swap(slope_1, slope_2);
+void draw_shadowed_triangle(const triangle &t, const u32 *texture) {
+    textured_triangle(snap_to_pixel(t.points[0]), snap_to_pixel(t.points[1]),
+                      snap_to_pixel(t.points[2]), t.uv[0], t.uv[1], t.uv[2],
+                      &t, true, texture);
+}
+
+void draw_lightmapped_triangle(const triangle &t, const u32 *texture) {
+    textured_triangle(snap_to_pixel(t.points[0]), snap_to_pixel(t.points[1]),
+                      snap_to_pixel(t.points[2]), t.uv[0], t.uv[1], t.uv[2],
+                      &t, false, texture);
+}
+
+void draw_gouraud_triangle(const triangle &t) {
+    Vec4 a = t.points[0];
+    Vec4 b = t.points[1];
+    Vec4 c = t.points[2];
+
+    auto shade = [&](i32 x, i32 y) {
+        if (interlace_skip(x, y) || frame_buffer.kept(x, y)) {
+            return;
         }
 
-        f32 x_start = x0;
-        f32 x_end = x0;
+        Vec3 w = perspective_weights(a, b, c, x, y);
 
-        for (i32 y = y0; y <= my; y++) {
-            for (i32 x = x_start; x <= x_end; x++) {
-                draw_texel(x, y, texture, a, b, c, a_uv, b_uv, c_uv);
-            }
-            x_start += slope_1;
-            x_end += slope_2;
+        u32 color = t.colors[0] & 0xff000000;
+        for (u32 shift = 0; shift < 24; shift += 8) {
+            f32 channel = ((t.colors[0] >> shift) & 0xff) * w.x +
+                          ((t.colors[1] >> shift) & 0xff) * w.y +
+                          ((t.colors[2] >> shift) & 0xff) * w.z;
+            channel = std::clamp(channel, 0.0f, 255.0f);
+            color |= static_cast<u32>(channel) << shift;
         }
-    }
-    // fill_flat_top_triangle();
-    {
-        // y slope
-        f32 slope_1 = static_cast<f32>(x2 - x1) / (y2 - y1);
-        f32 slope_2 = static_cast<f32>(x2 - mx) / (y2 - my);
 
-        if (slope_1 < slope_2) {
-            std::swap(slope_1, slope_2);
+        draw_pixel(x, y, color);
+    };
+
+    scan_triangle(a.x, a.y, b.x, b.y, c.x, c.y,
+                  full_rect(window_width, window_height), shade);
+}
+
+void draw_lit_triangle(const triangle &t) {
+    Vec4 a = t.points[0];
+    Vec4 b = t.points[1];
+    Vec4 c = t.points[2];
+    Vec3 world[3] = {t.world[0], t.world[1], t.world[2]};
+    Vec3 normals[3] = {t.normals[0], t.normals[1], t.normals[2]};
+
+    auto shade = [&](i32 x, i32 y) {
+        if (interlace_skip(x, y) || frame_buffer.kept(x, y)) {
+            return;
         }
 
-        f32 x_start = x2;
-        f32 x_end = x2;
+        Vec3 w = perspective_weights(a, b, c, x, y);
 
-        for (i32 y = y2; y >= y1; y--) {
-            for (i32 x = x_start; x <= x_end; x++) {
-                draw_texel(x, y, texture, a, b, c, a_uv, b_uv, c_uv);
-            }
-            x_start -= slope_1;
-            x_end -= slope_2;
+        Vec3 position = world[0] * w.x + world[1] * w.y + world[2] * w.z;
+        Vec3 normal = normals[0] * w.x + normals[1] * w.y + normals[2] * w.z;
+
+        f32 length = len(normal);
+        if (length > 0) {
+            normal = normal / length;
         }
-    }
+
+        Vec3 intensity = shade_point(position, normal, x, y);
+        draw_pixel(x, y, light_apply_color(t.base_color, intensity));
+    };
+
+    scan_triangle(a.x, a.y, b.x, b.y, c.x, c.y,
+                  full_rect(window_width, window_height), shade);
 }
@@ -1,4 +1,8 @@
+#pragma once
+
 #include "core.hpp"
+#include "display.hpp"
+#include "interlace.hpp"
 #include "vector.hpp"
 #include <cstdlib>
 
@@ -8,11 +12,32 @@ typedef struct {
     int c;
 } face;
 
+struct Lightmap;
+
+// inclusive pixel bounds
+struct ClipRect {
+    i32 x0, y0, x1, y1;
+};
+
+inline ClipRect full_rect(u32 width, u32 height) {
+    return {0, 0, static_cast<i32>(width) - 1, static_cast<i32>(height) - 1};
+}
+
 typedef struct {
     Vec4 points[3];
     Vec2 uv[3];
     u32 color;
     f32 avg_depth;
+
+    // lighting inputs for the gouraud and per pixel shading modes
+    u32 base_color;  // unlit color
+    u32 colors[3];   // lit vertex colors
+    Vec3 world[3];   // world space positions
+    Vec3 normals[3]; // world space vertex normals
+
+    // baked lighting of static meshes, null when lit per frame
+    const Lightmap *lightmap;
+    Vec2 lightmap_uv[3];
 } triangle;
 
 void draw_triangle(i32 x0, i32 y0, //
@@ -26,4 +51,129 @@ void draw_textured_triangle(i32 x0, i32 y0, f32 z0, f32 w0, f32 u0, f32 v0, //
                             i32 x2, i32 y2, f32 z2, f32 w2, f32 u2, f32 v2,
                             const u32 *texture);
 
+enum DepthFunc {
+    DEPTH_OFF,   // no depth test or write
+    DEPTH_LESS,  // pass when nearer, writes depth
+    DEPTH_EQUAL, // pass when equal to the prepass depth, no write
+};
+
+// depth test of draw_textured_triangle() against frame_buffer.depth
+extern DepthFunc depth_func;
+
+// z / w is affine in screen space, so it is stored as a plane evaluated at
+// integer pixels. every pass builds it the same way from the same points,
+// which makes an equal depth test after a prepass exact
+struct DepthPlane {
+    f32 z; // depth at pixel 0, 0
+    f32 dzdx;
+    f32 dzdy;
+};
+
+DepthPlane depth_plane(Vec4 a, Vec4 b, Vec4 c);
+
+inline f32 depth_at(const DepthPlane &plane, i32 x, i32 y) {
+    return plane.z + plane.dzdx * x + plane.dzdy * y;
+}
+
+// depth only path, no attributes and no color writes. nearer depths are
+// written to a width x height target, so it serves the z prepass into
+// frame_buffer.depth as well as shadow and occlusion maps
+void draw_depth_triangle(Vec4 a, Vec4 b, Vec4 c, f32 *depth, u32 width,
+                         u32 height);
+// same, only touching pixels inside clip, rows are pitch apart
+void draw_depth_triangle(Vec4 a, Vec4 b, Vec4 c, f32 *depth, u32 pitch,
+                         ClipRect clip);
+
+// textured with the equal depth test of draw_textured_triangle(), texels
+// darkened by sample_shadow() at the interpolated world position and by the
+// lightmap when the triangle has one
+void draw_shadowed_triangle(const triangle &t, const u32 *texture);
+// texture, or base_color when texture is null, times one lightmap fetch
+void draw_lightmapped_triangle(const triangle &t, const u32 *texture);
+
+// vertex colors interpolated across the triangle
+void draw_gouraud_triangle(const triangle &t);
+// world position and normal interpolated, lit per pixel by shade_point()
+void draw_lit_triangle(const triangle &t);
+
 Vec3 barycentric_weights(Vec2 a, Vec2 b, Vec2 c, Vec2 p);
+
+// calls pixel(x, y) for every pixel covered by the triangle, using the same
+// flat bottom / flat top split as draw_filled_triangle() and skipping
+// pixels outside clip
+template <typename F>
+void scan_triangle(i32 x0, i32 y0, i32 x1, i32 y1, i32 x2, i32 y2,
+                   ClipRect clip, F pixel) {
+    if (y0 > y1) {
+        std::swap(x0, x1);
+        std::swap(y0, y1);
+    }
+    if (y1 > y2) {
+        std::swap(x1, x2);
+        std::swap(y1, y2);
+    }
+    if (y0 > y1) {
+        std::swap(x0, x1);
+        std::swap(y0, y1);
+    }
+
+    // degenerate, nothing to cover
+    if (y0 == y2) {
+        return;
+    }
+
+    auto span = [&](i32 y, f32 x_start, f32 x_end) {
+        if (y < clip.y0 || y > clip.y1) {
+            return;
+        }
+        i32 first = std::max(static_cast<i32>(x_start), clip.x0);
+        i32 last = std::min(static_cast<i32>(x_end), clip.x1);
+        for (i32 x = first; x <= last; x++) {
+            pixel(x, y);
+        }
+    };
+
+    i32 my = y1;
+    i32 mx = static_cast<f32>((x2 - x0) * (y1 - y0)) / (y2 - y0) + x0;
+    // fill_flat_bottom_triangle();
+    {
+        // y slope
+        f32 slope_1 = static_cast<f32>(x1 - x0) / (y1 - y0);
+        f32 slope_2 = static_cast<f32>(mx - x0) / (my - y0);
+
+        if (slope_1 > slope_2) {
+            std::swap(slope_1, slope_2);
+        }
+
+        f32 x_start = x0;
+        f32 x_end = x0;
+
+        // the middle row belongs to the flat top half unless that is empty
+        i32 y_end = y1 == y2 ? my : my - 1;
+        for (i32 y = y0; y <= y_end; y++) {
+            span(y, x_start, x_end);
+            x_start += slope_1;
+            x_end += slope_2;
+        }
+    }
+    // fill_flat_top_triangle();
+    {
+        // y slope
+        f32 slope_1 = static_cast<f32>(x2 - x1) / (y2 - y1);
+        f32 slope_2 = static_cast<f32>(x2 - mx) / (y2 - my);
+
+        if (slope_1 < slope_2) {
+            std::swap(slope_1, slope_2);
+        }
+
+        f32 x_start = x2;
+        f32 x_end = x2;
+
+        i32 y_end = y1 == y2 ? y2 + 1 : y1;
+        for (i32 y = y2; y >= y_end; y--) {
+            span(y, x_start, x_end);
+            x_start -= slope_1;
+            x_end -= slope_2;
+        }
+    }
+}
@@ -0,0 +1,284 @@
+#include "video.hpp"
+
+#include <immintrin.h>
+#include <string.h>
+
+void encode_y4m_header(u32 width, u32 height, u32 rate, std::vector<u8> &out) {
+    char header[96];
+    i32 size = snprintf(header, sizeof(header),
+                        "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg\n", width,
+                        height, rate);
+    out.assign(header, header + size);
+}
+
+usize y4m_frame_size(u32 width, u32 height) {
+    usize chroma = static_cast<usize>((width + 1) / 2) * ((height + 1) / 2);
+    return static_cast<usize>(width) * height + chroma * 2;
+}
+
+// integer bt.601 weights out of 256, the vector paths below round the same
+static u8 luma(i32 r, i32 g, i32 b) {
+    return ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+}
+
+static u8 chroma_u(i32 r, i32 g, i32 b) {
+    return ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+}
+
+static u8 chroma_v(i32 r, i32 g, i32 b) {
+    return ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+}
+
+struct Rgb8 {
+    __m256i r, g, b;
+};
+
+// channels of 8 argb pixels, one per 32 bit lane
+static Rgb8 unpack_rgb(const u32 *pixels) {
+    __m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pixels));
+    const __m256i mask = _mm256_set1_epi32(0xff);
+    return {_mm256_and_si256(_mm256_srli_epi32(p, 16), mask),
+            _mm256_and_si256(_mm256_srli_epi32(p, 8), mask),
+            _mm256_and_si256(p, mask)};
+}
+
+static __m256i weigh(Rgb8 c, i32 wr, i32 wg, i32 wb, i32 offset) {
+    __m256i sum = _mm256_mullo_epi32(c.r, _mm256_set1_epi32(wr));
+    sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(c.g, _mm256_set1_epi32(wg)));
+    sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(c.b, _mm256_set1_epi32(wb)));
+    sum = _mm256_srai_epi32(_mm256_add_epi32(sum, _mm256_set1_epi32(128)), 8);
+    return _mm256_add_epi32(sum, _mm256_set1_epi32(offset));
+}
+
+// low byte of each lane into 8 consecutive bytes
+static void store_bytes(u8 *out, __m256i v) {
+    v = _mm256_packus_epi32(v, v);
+    v = _mm256_packus_epi16(v, v);
+    v = _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0,
+                                                         0));
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(out),
+                     _mm256_castsi256_si128(v));
+}
+
+static void convert_luma_row(const u32 *row, u32 width, u8 *out) {
+    u32 x = 0;
+    for (; x + 8 <= width; x += 8) {
+        store_bytes(out + x, weigh(unpack_rgb(row + x), 66, 129, 25, 16));
+    }
+    for (; x < width; x++) {
+        u32 p = row[x];
+        out[x] = luma(p >> 16 & 0xff, p >> 8 & 0xff, p & 0xff);
+    }
+}
+
+// sums of the 2x2 blocks under 16 pixels of two rows, 8 blocks in order
+static __m256i block_sums(__m256i top0, __m256i top1, __m256i bottom0,
+                          __m256i bottom1) {
+    __m256i sums = _mm256_hadd_epi32(_mm256_add_epi32(top0, bottom0),
+                                     _mm256_add_epi32(top1, bottom1));
+    return _mm256_permute4x64_epi64(sums, 0b11011000);
+}
+
+// one row of u and v from two rows of pixels, bottom may equal top at the
+// end of an odd height frame
+static void convert_chroma_row(const u32 *top, const u32 *bottom, u32 width,
+                               u8 *u, u8 *v) {
+    u32 x = 0;
+    for (; x + 16 <= width; x += 16) {
+        Rgb8 t0 = unpack_rgb(top + x);
+        Rgb8 t1 = unpack_rgb(top + x + 8);
+        Rgb8 b0 = unpack_rgb(bottom + x);
+        Rgb8 b1 = unpack_rgb(bottom + x + 8);
+
+        const __m256i round = _mm256_set1_epi32(2);
+        auto average = [&](__m256i s) {
+            return _mm256_srli_epi32(_mm256_add_epi32(s, round), 2);
+        };
+        Rgb8 block = {average(block_sums(t0.r, t1.r, b0.r, b1.r)),
+                      average(block_sums(t0.g, t1.g, b0.g, b1.g)),
+                      average(block_sums(t0.b, t1.b, b0.b, b1.b))};
+
+        store_bytes(u + x / 2, weigh(block, -38, -74, 112, 128));
+        store_bytes(v + x / 2, weigh(block, 112, -94, -18, 128));
+    }
+
+    // the last column of an odd width frame pairs with itself
+    for (; x < width; x += 2) {
+        u32 right = std::min(x + 1, width - 1);
+        u32 pixels[4] = {top[x], top[right], bottom[x], bottom[right]};
+        i32 r = 0, g = 0, b = 0;
+        for (u32 p : pixels) {
+            r += p >> 16 & 0xff;
+            g += p >> 8 & 0xff;
+            b += p & 0xff;
+        }
+        r = (r + 2) >> 2;
+        g = (g + 2) >> 2;
+        b = (b + 2) >> 2;
+        u[x / 2] = chroma_u(r, g, b);
+        v[x / 2] = chroma_v(r, g, b);
+    }
+}
+
+void convert_yuv420(ImageView image, u32 first_row, u32 last_row,
+                    u8 *planes) {
+    const u32 width = image.width;
+    const u32 chroma_width = (width + 1) / 2;
+    u8 *y_plane = planes;
+    u8 *u_plane = y_plane + static_cast<usize>(width) * image.height;
+    u8 *v_plane =
+        u_plane + static_cast<usize>(chroma_width) * ((image.height + 1) / 2);
+
+    for (u32 y = first_row; y < last_row; y++) {
+        const u32 *row = image.pixels + static_cast<usize>(y) * image.pitch;
+        convert_luma_row(row, width, y_plane + static_cast<usize>(y) * width);
+    }
+
+    for (u32 y = first_row; y < last_row; y += 2) {
+        const u32 *top = image.pixels + static_cast<usize>(y) * image.pitch;
+        const u32 *bottom = y + 1 < image.height ? top + image.pitch : top;
+        usize offset = static_cast<usize>(y / 2) * chroma_width;
+        convert_chroma_row(top, bottom, width, u_plane + offset,
+                           v_plane + offset);
+    }
+}
+
+static void put_token(std::vector<u8> &out, DeltaOp op, usize count) {
+    u32 token = static_cast<u32>(count) << 2 | op;
+    const u8 *bytes = reinterpret_cast<const u8 *>(&token);
+    out.insert(out.end(), bytes, bytes + sizeof(token));
+}
+
+// pixels from i on that match previous, 8 at a time while they last
+static usize unchanged_run(const u32 *pixels, const u32 *previous, usize i,
+                           usize last) {
+    usize start = i;
+    for (; i + 8 <= last; i += 8) {
+        __m256i a =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pixels + i));
+        __m256i b =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(previous + i));
+        u32 equal = _mm256_movemask_ps(
+            _mm256_castsi256_ps(_mm256_cmpeq_epi32(a, b)));
+        if (equal != 0xff) {
+            return i - start + std::countr_one(equal);
+        }
+    }
+    while (i < last && pixels[i] == previous[i]) {
+        i++;
+    }
+    return i - start;
+}
+
+static usize same_run(const u32 *pixels, usize i, usize last) {
+    usize start = i;
+    while (i < last && pixels[i] == pixels[start]) {
+        i++;
+    }
+    return i - start;
+}
+
+// runs shorter than this are cheaper as literals
+#define DELTA_MIN_RUN 3
+
+void encode_delta(const u32 *pixels, const u32 *previous, usize first,
+                  usize last, std::vector<u8> &out) {
+    // counts have to fit in 30 bits
+    const usize max_count = (1u << 30) - 1;
+
+    usize i = first;
+    while (i < last) {
+        usize skip = previous ? unchanged_run(pixels, previous, i, last) : 0;
+        if (skip >= DELTA_MIN_RUN || (skip > 0 && skip == last - i)) {
+            skip = std::min(skip, max_count);
+            put_token(out, DELTA_SKIP, skip);
+            i += skip;
+            continue;
+        }
+
+        usize same = std::min(same_run(pixels, i, last), max_count);
+        if (same >= DELTA_MIN_RUN) {
+            put_token(out, DELTA_FILL, same);
+            const u8 *bytes = reinterpret_cast<const u8 *>(pixels + i);
+            out.insert(out.end(), bytes, bytes + sizeof(u32));
+            i += same;
+            continue;
+        }
+
+        // literals until a run worth a token starts
+        usize end = i + 1;
+        while (end < last && end - i < max_count) {
+            bool run = end + DELTA_MIN_RUN <= last &&
+                       pixels[end] == pixels[end + 1] &&
+                       pixels[end] == pixels[end + 2];
+            bool unchanged = previous && end + DELTA_MIN_RUN <= last &&
+                             pixels[end] == previous[end] &&
+                             pixels[end + 1] == previous[end + 1] &&
+                             pixels[end + 2] == previous[end + 2];
+            if (run || unchanged) {
+                break;
+            }
+            end++;
+        }
+        put_token(out, DELTA_COPY, end - i);
+        const u8 *bytes = reinterpret_cast<const u8 *>(pixels + i);
+        out.insert(out.end(), bytes, bytes + (end - i) * sizeof(u32));
+        i = end;
+    }
+}
+
+bool decode_delta(std::span<const u8> data, std::vector<u32> &pixels,
+                  u32 &width, u32 &height) {
+    DeltaHeader header;
+    if (data.size() < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, data.data(), sizeof(header));
+    if (memcmp(header.magic, "RPDF", 4) != 0 ||
+        data.size() - sizeof(header) < header.payload_size) {
+        return false;
+    }
+
+    usize pixel_count = static_cast<usize>(header.width) * header.height;
+    if (header.flags & DELTA_KEYFRAME) {
+        pixels.assign(pixel_count, 0);
+    } else if (pixels.size() != pixel_count) {
+        return false;
+    }
+    width = header.width;
+    height = header.height;
+
+    const u8 *p = data.data() + sizeof(header);
+    const u8 *end = p + header.payload_size;
+    usize i = 0;
+    while (p + sizeof(u32) <= end) {
+        u32 token;
+        memcpy(&token, p, sizeof(token));
+        p += sizeof(token);
+
+        usize count = token >> 2;
+        u32 op = token & 3;
+        if (count > pixel_count - i) {
+            return false;
+        }
+
+        if (op == DELTA_SKIP) {
+            if (header.flags & DELTA_KEYFRAME) {
+                return false;
+            }
+        } else if (op == DELTA_FILL && end - p >= 4) {
+            u32 value;
+            memcpy(&value, p, sizeof(value));
+            p += sizeof(value);
+            std::fill_n(pixels.begin() + i, count, value);
+        } else if (op == DELTA_COPY &&
+                   static_cast<usize>(end - p) >= count * sizeof(u32)) {
+            memcpy(pixels.data() + i, p, count * sizeof(u32));
+            p += count * sizeof(u32);
+        } else {
+            return false;
+        }
+        i += count;
+    }
+    return p == end && i == pixel_count;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "core.hpp"
+#include "image.hpp"
+
+// raw video for other programs: y4m for encoders, and a delta codec for
+// consumers on the same machine that want the frames cheaply
+
+// "YUV4MPEG2 ..." stream header, 4:2:0 with chroma centered between pixels
+void encode_y4m_header(u32 width, u32 height, u32 rate, std::vector<u8> &out);
+
+// bytes of a y4m frame after its "FRAME\n" line
+usize y4m_frame_size(u32 width, u32 height);
+
+// bt.601 studio range conversion of rows [first_row, last_row) of image
+// into the planes of a whole frame, first_row must be even. separate row
+// ranges write separate bytes and can be converted in parallel
+void convert_yuv420(ImageView image, u32 first_row, u32 last_row, u8 *planes);
+
+// delta frames start with this header, followed by payload_size bytes of
+// tokens. each token is a little endian u32 holding count << 2 | op
+struct DeltaHeader {
+    char magic[4]; // "RPDF"
+    u32 width;
+    u32 height;
+    u32 flags;
+    u32 payload_size;
+};
+
+enum DeltaFlags {
+    DELTA_KEYFRAME = 1, // no token refers to the previous frame
+};
+
+enum DeltaOp {
+    DELTA_SKIP = 0, // count pixels unchanged from the previous frame
+    DELTA_FILL = 1, // count pixels of the argb value in the next u32
+    DELTA_COPY = 2, // count argb pixels follow
+};
+
+// append the tokens for pixels [first, last) of a tightly packed argb
+// frame, against previous or as part of a keyframe when it is null. token
+// runs never cross first or last, so ranges can be encoded in parallel and
+// concatenated
+void encode_delta(const u32 *pixels, const u32 *previous, usize first,
+                  usize last, std::vector<u8> &out);
+
+// header and tokens of one frame into pixels, which holds the previous
+// frame for delta frames. false if data is not a valid frame
+bool decode_delta(std::span<const u8> data, std::vector<u32> &pixels,
+                  u32 &width, u32 &height);